@@ -0,0 +1,163 @@
+#include "config.h"
+
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+/* globals normally defined in whowatch.c */
+unsigned long long ticks;
+bool full_cmd = true;
+const char *proc_dir = "/proc";
+const char *utmp_file = "/var/run/utmp";
+const char *wtmp_file = "/var/log/wtmp";
+
+/* loop.c, there is no main loop here */
+void loop_signal(int sig, void (*func)(int sig))
+{
+}
+
+unsigned long long bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * System calls made by fn(arg) in a traced child, setup(arg) runs
+ * before tracing starts. With fn null the cost of getting there and
+ * out is counted.
+ */
+static long count_syscalls(void (*setup)(void *), void (*fn)(void *),
+			   void *arg)
+{
+	pid_t pid;
+	int status;
+	long stops = 0;
+
+	fflush(stdout);
+	if (!(pid = fork())) {
+		if (ptrace(PTRACE_TRACEME, 0, 0, 0) == -1)
+			_exit(1);
+		if (setup) setup(arg);
+		raise(SIGSTOP);
+		if (fn) fn(arg);
+		_exit(0);
+	}
+	if (pid == -1) return -1;
+	if (waitpid(pid, &status, 0) == -1 || !WIFSTOPPED(status))
+		return -1;
+	for (;;) {
+		if (ptrace(PTRACE_SYSCALL, pid, 0, 0) == -1) {
+			kill(pid, SIGKILL);
+			waitpid(pid, &status, 0);
+			return -1;
+		}
+		if (waitpid(pid, &status, 0) == -1 || WIFEXITED(status))
+			break;
+		stops++;
+	}
+	/* every system call stops twice, on entry and on exit */
+	return (stops + 1) / 2;
+}
+
+long bench_syscalls(void (*fn)(void *), void *arg)
+{
+	long n, base;
+
+	if ((n = count_syscalls(0, fn, arg)) == -1 ||
+	    (base = count_syscalls(0, 0, arg)) == -1)
+		return -1;
+	return n - base;
+}
+
+#ifdef __GLIBC__
+/*
+ * Allocations are counted by taking malloc() and friends from the
+ * C library, which exports its own under other names.
+ */
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+static long allocs;
+
+void *malloc(size_t size)
+{
+	allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+long bench_allocs(void)
+{
+	return allocs;
+}
+#else
+long bench_allocs(void)
+{
+	return -1;
+}
+#endif
+
+void bench_ops(const char *name, void (*setup)(void *),
+	       void (*fn)(void *), void *arg, int rounds, double ops,
+	       const char *fmt, ...)
+{
+	unsigned long long t = 0, t0;
+	long a = 0, a0, sc, base;
+	char fields[256];
+	va_list ap;
+	int i;
+
+	for (i = 0; i < rounds; i++) {
+		if (setup) setup(arg);
+		a0 = bench_allocs();
+		t0 = bench_now();
+		fn(arg);
+		t += bench_now() - t0;
+		a += bench_allocs() - a0;
+	}
+	sc = count_syscalls(setup, fn, arg);
+	base = count_syscalls(setup, 0, arg);
+	va_start(ap, fmt);
+	vsnprintf(fields, sizeof fields, fmt, ap);
+	va_end(ap);
+	ops *= rounds;
+	bench_report(name, "%s ns_per_op=%.1f allocs_per_op=%.3f "
+		     "syscalls_per_op=%.3f", fields, t / ops,
+		     bench_allocs() < 0 ? -1.0 : a / ops,
+		     sc < 0 || base < 0 ? -1.0 : (sc - base) / (ops / rounds));
+}
+
+void bench_report(const char *name, const char *fmt, ...)
+{
+	va_list ap;
+
+	printf("%s ", name);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+	fflush(stdout);
+}
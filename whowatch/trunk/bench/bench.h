@@ -0,0 +1,30 @@
+/*
+ * Helpers shared by the benchmark programs. Results are printed
+ * one per line as "name key=value ..." so they are easy to compare
+ * between runs and to feed into other tools.
+ */
+#include <stdbool.h>
+
+/* monotonic time in nanoseconds */
+unsigned long long bench_now(void);
+
+/*
+ * Number of system calls made by fn(arg). It is run in a child
+ * traced with ptrace(2), returns -1 if tracing is not permitted.
+ */
+long bench_syscalls(void (*fn)(void *), void *arg);
+
+/* heap allocations made so far, -1 if they are not counted */
+long bench_allocs(void);
+
+/*
+ * Run fn(arg) rounds times, each call doing ops operations, and
+ * report ns, allocations and system calls per operation after the
+ * fields given by fmt. setup(arg), if not null, runs before every
+ * call and is not measured.
+ */
+void bench_ops(const char *name, void (*setup)(void *),
+	       void (*fn)(void *), void *arg, int rounds, double ops,
+	       const char *fmt, ...);
+
+void bench_report(const char *name, const char *fmt, ...);
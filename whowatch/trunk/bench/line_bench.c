@@ -0,0 +1,86 @@
+/*
+ * Cost of the process window line index: inserting lines at
+ * arbitrary positions, finding the line at a position (scrolling,
+ * to_line()), the position of a line and deleting lines, at 100
+ * to 1M lines. Each should grow only logarithmically.
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "whowatch.h"	/* includes ostree.h */
+#include "bench.h"
+
+#define ROUNDS		5
+#define OPS		100000		/* lookups per round		*/
+
+static struct os_tree tree;
+static struct os_node *nodes;
+
+static void clear_lines(void *unused)
+{
+	memset(&tree, 0, sizeof tree);
+}
+
+static void insert_lines(void *n)
+{
+	unsigned int i;
+
+	for (i = 0; i < *(unsigned int *) n; i++)
+		os_insert(&tree, &nodes[i], random() % (i + 1));
+}
+
+static void fill_lines(void *n)
+{
+	clear_lines(0);
+	insert_lines(n);
+}
+
+static void select_lines(void *n)
+{
+	int k;
+
+	for (k = 0; k < OPS; k++)
+		if (!os_select(&tree, random() % *(unsigned int *) n)) abort();
+}
+
+static void rank_lines(void *n)
+{
+	unsigned int m = *(unsigned int *) n;
+	int k;
+
+	for (k = 0; k < OPS; k++)
+		if (os_rank(&nodes[random() % m]) >= m) abort();
+}
+
+static void delete_lines(void *n)
+{
+	unsigned int i;
+
+	for (i = *(unsigned int *) n; i > 0; i--)
+		os_delete(&tree, os_select(&tree, random() % i));
+	if (os_count(&tree)) abort();
+}
+
+static void run(unsigned int n)
+{
+	nodes = xcalloc(n, sizeof *nodes);
+	srandom(n);
+	bench_ops("lines.insert", clear_lines, insert_lines, &n, ROUNDS, n,
+		  "lines=%u", n);
+	bench_ops("lines.select", 0, select_lines, &n, ROUNDS, OPS, "lines=%u", n);
+	bench_ops("lines.rank", 0, rank_lines, &n, ROUNDS, OPS, "lines=%u", n);
+	bench_ops("lines.delete", fill_lines, delete_lines, &n, ROUNDS, n,
+		  "lines=%u", n);
+	free(nodes);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int n;
+
+	for (n = 100; n <= 1000000; n *= 10)
+		run(n);
+	return 0;
+}
@@ -0,0 +1,409 @@
+/*
+ * Make a synthetic system for whowatch and the benchmarks to read:
+ * DIR/proc with stat, status, cmdline and fd links of every process
+ * and net/tcp for the sockets among them, and DIR/utmp and DIR/wtmp
+ * with the sessions. Processes form a tree of the given depth and
+ * fanout under init and the login shells. Nothing needs root:
+ *
+ *	mkfixture -n 20000 -u 200 /tmp/fx
+ *	whowatch --proc /tmp/fx/proc --utmp /tmp/fx/utmp --wtmp /tmp/fx/wtmp
+ *	make bench FIXTURE=/tmp/fx
+ *
+ * With -c the tree keeps changing: every second that many leaf
+ * processes exit and as many new ones start, and with -l that many
+ * sessions log out and in again through wtmp. The same seed gives
+ * the same fixture and the same changes.
+ */
+#include "config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <utmpx.h>
+
+#define FIRST_PID	100
+#define MAX_PID		4194304
+
+struct node
+{
+	int pid;
+	int parent;			/* index, -1 for init		*/
+	int depth;
+	int children;
+	int user;			/* session it belongs to or -1	*/
+	const char *comm;
+	bool alive;
+};
+
+static const char *comms[] = {
+	"bash", "vim", "make", "cc1", "python3", "ssh", "less", "top",
+	"postgres", "nginx", "java", "node", "sleep", "tmux", "git",
+};
+#define NCOMMS	(sizeof comms / sizeof *comms)
+
+static char root[PATH_MAX - 64];
+static struct node *nodes;
+static int nnodes, max_nodes, nalive;
+static int next_pid = FIRST_PID;
+static int max_depth = 6, fanout = 4;
+static int *shells;			/* node of each login shell	*/
+static int nusers = 20;
+static unsigned int sockets;		/* inodes handed out		*/
+static time_t boot;
+
+static char *path(const char *fmt, ...)
+{
+	static char buf[PATH_MAX];
+	va_list ap;
+	int n;
+
+	n = snprintf(buf, sizeof buf, "%s/", root);
+	va_start(ap, fmt);
+	vsnprintf(buf + n, sizeof buf - n, fmt, ap);
+	va_end(ap);
+	return buf;
+}
+
+static void write_file(const char *name, const char *data, size_t len)
+{
+	int fd;
+
+	if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+		err(EXIT_FAILURE, "%s", name);
+	if (write(fd, data, len) != len)
+		err(EXIT_FAILURE, "%s", name);
+	close(fd);
+}
+
+static void write_tcp(void)
+{
+	char *buf, *p;
+	unsigned int i;
+
+	p = buf = malloc(160 * (sockets + 1));
+	p += sprintf(p, "  sl  local_address rem_address   st tx_queue "
+		     "rx_queue tr tm->when retrnsmt   uid  timeout inode\n");
+	for (i = 0; i < sockets; i++)
+		p += sprintf(p, "%4u: 0100007F:%04X 0A00%04X:%04X 01 "
+			     "00000000:00000000 00:00000000 00000000  1000 "
+			     "       0 %u\n", i, 1024 + i % 60000,
+			     i % 65536, 22, 10000 + i);
+	write_file(path("proc/net/tcp"), buf, p - buf);
+	free(buf);
+}
+
+/*
+ * Write /proc/<pid> of node i.
+ */
+static void write_proc(int i)
+{
+	struct node *n = &nodes[i];
+	int ppid = n->parent == -1 ? 0 : nodes[n->parent].pid;
+	int tty = n->user == -1 ? 0 : 34816 + n->user;
+	int tpgid = n->user == -1 ? -1 : nodes[shells[n->user]].pid;
+	const char *comm = n->comm;
+	char buf[1024], dir[PATH_MAX];
+	int len;
+
+	snprintf(dir, sizeof dir, "%s", path("proc/%d", n->pid));
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+		err(EXIT_FAILURE, "%s", dir);
+
+	len = snprintf(buf, sizeof buf, "%d (%s) %c %d %d %d %d %d 4194304 "
+		       "%d 0 0 0 %d %d 0 0 20 0 1 0 %lu %lu %d "
+		       "18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 %d "
+		       "0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+		       n->pid, comm, n->pid % 7 ? 'S' : 'R', ppid, n->pid,
+		       n->pid, tty, tpgid, n->pid % 1000, n->pid % 300,
+		       n->pid % 200, (unsigned long) (n->pid * 7 % 100000),
+		       (unsigned long) (n->pid % 97 + 1) * 4096 * 1024,
+		       n->pid % 97 * 100 + 50, n->pid % 8);
+	write_file(path("proc/%d/stat", n->pid), buf, len);
+
+	len = snprintf(buf, sizeof buf, "Name:\t%s\nState:\tS (sleeping)\n"
+		       "Tgid:\t%d\nPid:\t%d\nPPid:\t%d\n"
+		       "Uid:\t%d\t%d\t%d\t%d\nGid:\t%d\t%d\t%d\t%d\n"
+		       "VmPeak:\t%8d kB\nVmSize:\t%8d kB\nVmRSS:\t%8d kB\n"
+		       "VmData:\t%8d kB\nVmStk:\t%8d kB\nVmExe:\t%8d kB\n"
+		       "VmLib:\t%8d kB\nThreads:\t1\n",
+		       comm, n->pid, n->pid, ppid,
+		       1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000,
+		       n->pid % 97 * 4096, n->pid % 97 * 4096,
+		       n->pid % 97 * 400 + 200, n->pid % 97 * 1000,
+		       132, 900, 2100);
+	write_file(path("proc/%d/status", n->pid), buf, len);
+
+	len = snprintf(buf, sizeof buf, "/usr/bin/%s%c--option=%d%cfile%d.txt",
+		       comm, 0, n->pid % 13, 0, n->pid);
+	write_file(path("proc/%d/cmdline", n->pid), buf, len + 1);
+
+	snprintf(dir, sizeof dir, "%s", path("proc/%d/fd", n->pid));
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+		err(EXIT_FAILURE, "%s", dir);
+	if (n->user != -1) {
+		snprintf(buf, sizeof buf, "/dev/pts/%d", n->user);
+		symlink(buf, path("proc/%d/fd/0", n->pid));
+		symlink(buf, path("proc/%d/fd/1", n->pid));
+		symlink(buf, path("proc/%d/fd/2", n->pid));
+	} else {
+		symlink("/dev/null", path("proc/%d/fd/0", n->pid));
+	}
+	if (!strcmp(comm, "sshd") || !strcmp(comm, "nginx") ||
+	    !strcmp(comm, "ssh")) {
+		snprintf(buf, sizeof buf, "socket:[%u]", 10000 + sockets++);
+		symlink(buf, path("proc/%d/fd/3", n->pid));
+	}
+	symlink("/var/log/app.log", path("proc/%d/fd/4", n->pid));
+}
+
+static void remove_proc(int i)
+{
+	static const char *files[] = {
+		"fd/0", "fd/1", "fd/2", "fd/3", "fd/4", "fd",
+		"stat", "status", "cmdline", "",
+	};
+	int pid = nodes[i].pid, f;
+
+	for (f = 0; f < sizeof files / sizeof *files; f++)
+		if (remove(path("proc/%d/%s", pid, files[f])) == -1 &&
+		    errno != ENOENT)
+			err(EXIT_FAILURE, "%s", path("proc/%d/%s", pid,
+						      files[f]));
+}
+
+/*
+ * A new process under parent, with a name from the list if comm
+ * is not given.
+ */
+static int add_node(int parent, int user, const char *comm)
+{
+	struct node *n;
+
+	if (nnodes == max_nodes) {
+		max_nodes = max_nodes ? max_nodes * 2 : 1024;
+		nodes = realloc(nodes, max_nodes * sizeof *nodes);
+		if (!nodes) err(EXIT_FAILURE, "realloc");
+	}
+	n = &nodes[nnodes];
+	n->pid = parent == -1 ? 1 : next_pid++;
+	if (next_pid == MAX_PID) next_pid = FIRST_PID;
+	n->parent = parent;
+	n->depth = parent == -1 ? 0 : nodes[parent].depth + 1;
+	n->children = 0;
+	n->user = user;
+	n->comm = comm ? comm : comms[random() % NCOMMS];
+	n->alive = true;
+	if (parent != -1) nodes[parent].children++;
+	nalive++;
+	return nnodes++;
+}
+
+static void utmp_record(struct utmpx *u, int user, short type, time_t t)
+{
+	memset(u, 0, sizeof *u);
+	u->ut_type = type;
+	u->ut_pid = nodes[shells[user]].pid;
+	snprintf(u->ut_line, sizeof u->ut_line, "pts/%d", user);
+	snprintf(u->ut_id, sizeof u->ut_id, "%u", (unsigned int) user % 1000);
+	snprintf(u->ut_user, sizeof u->ut_user, "user%d", user);
+	snprintf(u->ut_host, sizeof u->ut_host, "10.%d.%d.%d",
+		 user / 65536 % 256, user / 256 % 256, user % 256);
+	u->ut_tv.tv_sec = t;
+}
+
+static void append_wtmp(struct utmpx *u, int n)
+{
+	int fd = open(path("wtmp"), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+	if (fd == -1 || write(fd, u, n * sizeof *u) != n * sizeof *u)
+		err(EXIT_FAILURE, "%s", path("wtmp"));
+	close(fd);
+}
+
+/*
+ * Fill the tree breadth first, the login shells and init are the
+ * first level to grow from.
+ */
+static void build(int nproc)
+{
+	struct utmpx *u;
+	int sshd, i, j, c, head = 0;
+
+	add_node(-1, -1, "init");
+	sshd = add_node(0, -1, "sshd");
+	shells = malloc((nusers ? nusers : 1) * sizeof *shells);
+	for (i = 0; i < nusers; i++)
+		shells[i] = add_node(add_node(sshd, -1, "sshd"), i, "bash");
+	while (nalive < nproc) {
+		for (i = head, head = nnodes; i < head && nalive < nproc; i++) {
+			if (nodes[i].depth >= max_depth ||
+			    !strcmp(nodes[i].comm, "sshd"))
+				continue;
+			for (c = 0; c < fanout && nalive < nproc; c++)
+				add_node(i, nodes[i].user, 0);
+		}
+		if (head == nnodes)	/* full, the rest goes under init */
+			while (nalive < nproc)
+				add_node(0, -1, 0);
+	}
+	for (i = 0; i < nnodes; i++)
+		write_proc(i);
+
+	u = calloc(nusers + 1, sizeof *u);
+	for (i = j = 0; i < nusers; i++, j++)
+		utmp_record(&u[j], i, USER_PROCESS, boot + 60 + i);
+	write_file(path("utmp"), (char *) u, j * sizeof *u);
+	write_file(path("wtmp"), (char *) u, j * sizeof *u);
+	free(u);
+}
+
+static void write_system(void)
+{
+	char buf[512];
+	int len;
+
+	len = snprintf(buf, sizeof buf, "cpu  1000 20 3000 400000 50 0 10 0 0 0\n"
+		       "cpu0 1000 20 3000 400000 50 0 10 0 0 0\n"
+		       "intr 0\nctxt 0\nbtime %ld\nprocesses %d\n",
+		       (long) boot, next_pid);
+	write_file(path("proc/stat"), buf, len);
+	len = snprintf(buf, sizeof buf, "MemTotal:       16384000 kB\n"
+		       "MemFree:         8192000 kB\n");
+	write_file(path("proc/meminfo"), buf, len);
+	write_file(path("proc/sys/fs/file-nr"), "1024\t0\t100000\n", 14);
+	write_file(path("proc/sys/fs/file-max"), "100000\n", 7);
+	write_file(path("proc/uptime"), "3600.00 3500.00\n", 16);
+	write_file(path("proc/loadavg"), "0.10 0.20 0.30 1/100 100\n", 25);
+}
+
+static void make_dir(const char *name)
+{
+	if (mkdir(path("%s", name), 0755) == -1 && errno != EEXIST)
+		err(EXIT_FAILURE, "%s", path("%s", name));
+}
+
+/*
+ * One second of changes: n leaves exit and n processes start, and
+ * logins sessions log out and in again.
+ */
+static void churn(int n, int logins)
+{
+	struct utmpx u[2];
+	int i, k, tries, user;
+
+	for (k = 0; k < n; k++) {
+		for (tries = 0; tries < 100; tries++) {
+			i = 1 + random() % (nnodes - 1);
+			/* not init, sshd or a login shell */
+			if (nodes[i].alive && !nodes[i].children &&
+			    (nodes[i].user == -1 ? nodes[i].depth > 1 :
+			     shells[nodes[i].user] != i)) break;
+		}
+		if (tries == 100) break;
+		remove_proc(i);
+		nodes[i].alive = false;
+		nodes[nodes[i].parent].children--;
+		nalive--;
+	}
+	for (k = 0; k < n; k++) {
+		for (tries = 0; tries < 100; tries++) {
+			i = random() % nnodes;
+			if (nodes[i].alive && nodes[i].depth < max_depth &&
+			    strcmp(nodes[i].comm, "sshd")) break;
+		}
+		if (tries == 100) i = 0;
+		write_proc(add_node(i, nodes[i].user, 0));
+	}
+	for (k = 0; k < logins && nusers; k++) {
+		user = random() % nusers;
+		utmp_record(&u[0], user, DEAD_PROCESS, time(0));
+		utmp_record(&u[1], user, USER_PROCESS, time(0));
+		append_wtmp(u, 2);
+	}
+}
+
+static void usage(int status)
+{
+	fprintf(status ? stderr : stdout,
+		"usage: mkfixture [options] DIR\n"
+		"  -n N   processes (default 1000)\n"
+		"  -d N   depth of the tree (default 6)\n"
+		"  -f N   children of a process (default 4)\n"
+		"  -u N   logged in users (default 20)\n"
+		"  -c N   processes replaced every second\n"
+		"  -l N   sessions logging out and in every second\n"
+		"  -t N   stop changing after N seconds (default never)\n"
+		"  -s N   random seed (default 1)\n");
+	exit(status);
+}
+
+static int number(const char *s)
+{
+	char *end;
+	long n = strtol(s, &end, 10);
+
+	if (*end || n < 0 || n > INT_MAX) errx(EXIT_FAILURE, "bad number: %s", s);
+	return n;
+}
+
+int main(int argc, char **argv)
+{
+	int c, nproc = 1000, rate = 0, logins = 0, seconds = 0, seed = 1;
+	struct timeval t0, t1;
+	long sec;
+
+	while ((c = getopt(argc, argv, "n:d:f:u:c:l:t:s:h")) != -1) {
+		switch (c) {
+		case 'n': nproc = number(optarg); break;
+		case 'd': max_depth = number(optarg); break;
+		case 'f': fanout = number(optarg); break;
+		case 'u': nusers = number(optarg); break;
+		case 'c': rate = number(optarg); break;
+		case 'l': logins = number(optarg); break;
+		case 't': seconds = number(optarg); break;
+		case 's': seed = number(optarg); break;
+		case 'h': usage(EXIT_SUCCESS);
+		default: usage(EXIT_FAILURE);
+		}
+	}
+	if (optind != argc - 1) usage(EXIT_FAILURE);
+	if (max_depth < 3) max_depth = 3;
+	if (!fanout) fanout = 1;
+	if (nproc < 2 + 2 * nusers) nproc = 2 + 2 * nusers;
+	snprintf(root, sizeof root, "%s", argv[optind]);
+	srandom(seed);
+	boot = time(0) - 3600;
+
+	make_dir("");
+	if (mkdir(path("proc"), 0755) == -1)
+		err(EXIT_FAILURE, "%s", path("proc"));
+	make_dir("proc/net");
+	make_dir("proc/sys");
+	make_dir("proc/sys/fs");
+	build(nproc);
+	write_tcp();
+	write_system();
+	printf("%s: %d processes, %d users\n", root, nalive, nusers);
+	if (!rate && !logins) return 0;
+
+	gettimeofday(&t0, 0);
+	for (sec = 1; !seconds || sec <= seconds; sec++) {
+		churn(rate, logins);
+		if (rate) write_tcp();
+		gettimeofday(&t1, 0);
+		c = (t0.tv_sec + sec - t1.tv_sec) * 1000000L - t1.tv_usec +
+			t0.tv_usec;
+		if (c > 0) usleep(c);
+	}
+	return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Throughput of validate_proc() with the pid index at 1k to 1M
+ * processes, compared with the fixed 128 bucket chained table it
+ * replaced. proctree.c is included to get at its static functions.
+ */
+#include "../src/proctree.c"
+
+#include "bench.h"
+
+#define ROUNDS		5		/* of filling and emptying	*/
+#define LOOKUPS		2000000		/* per size, spread over rounds	*/
+#define STRIDE		7919		/* visit pids in scattered order */
+#define LEGACY_MAX	100000
+#define LEGACY_LOOKUPS	100000		/* chains get long, keep it short */
+
+static int *pids;
+
+static void no_del(void *unused)
+{
+}
+
+/* the old table: 128 chains, nodes allocated one by one */
+struct legacy {
+	struct legacy *next;
+	int pid;
+};
+
+static struct legacy *legacy_table[128];
+
+static struct legacy *legacy_find(int pid)
+{
+	struct legacy *p;
+
+	for (p = legacy_table[pid & 127]; p; p = p->next)
+		if (p->pid == pid) break;
+	return p;
+}
+
+static void legacy_clear(void *unused)
+{
+	struct legacy *p, *q;
+	int i;
+
+	for (i = 0; i < 128; i++)
+		for (p = legacy_table[i], legacy_table[i] = 0; p; p = q) {
+			q = p->next;
+			free(p);
+		}
+}
+
+static void legacy_insert(void *n)
+{
+	struct legacy *p;
+	int i;
+
+	for (i = 0; i < *(int *) n; i++) {
+		p = xcalloc(1, sizeof *p);
+		p->pid = pids[i];
+		p->next = legacy_table[p->pid & 127];
+		legacy_table[p->pid & 127] = p;
+	}
+}
+
+static void legacy_lookup(void *n)
+{
+	int i;
+
+	for (i = 0; i < *(int *) n; i++)
+		if (!legacy_find(pids[(i * (long) STRIDE) % *(int *) n])) abort();
+}
+
+static void clear_all(void *unused)
+{
+	struct proc_t *p, *q;
+
+	for (p = main_list; p; p = q) {
+		q = p->mlist.nx;
+		drop_proc(p, no_del);
+	}
+}
+
+static void insert_all(void *n)
+{
+	int i;
+
+	for (i = 0; i < *(int *) n; i++)
+		validate_proc(pids[i]);
+}
+
+static void lookup_all(void *n)
+{
+	int i;
+
+	for (i = 0; i < *(int *) n; i++)
+		validate_proc(pids[(i * (long) STRIDE) % *(int *) n]);
+}
+
+static void fill_all(void *n)
+{
+	clear_all(0);
+	insert_all(n);
+}
+
+static void run(int n)
+{
+	int i, rounds;
+
+	for (i = 0; i < n; i++)
+		pids[i] = 2 + i * 4;	/* pid_max is 4M, keep them sparse */
+	rounds = LOOKUPS / n ? LOOKUPS / n : 1;
+
+	bench_ops("pidindex.insert", clear_all, insert_all, &n, ROUNDS, n,
+		  "procs=%d", n);
+	bench_ops("pidindex.lookup", 0, lookup_all, &n, rounds, n,
+		  "procs=%d", n);
+	bench_ops("pidindex.remove", fill_all, clear_all, &n, ROUNDS, n,
+		  "procs=%d", n);
+	if (n > LEGACY_MAX) return;
+
+	rounds = LEGACY_LOOKUPS / n ? LEGACY_LOOKUPS / n : 1;
+	bench_ops("pidindex.legacy_insert", legacy_clear, legacy_insert, &n,
+		  ROUNDS, n, "procs=%d", n);
+	bench_ops("pidindex.legacy_lookup", 0, legacy_lookup, &n, rounds, n,
+		  "procs=%d", n);
+	legacy_clear(0);
+}
+
+int main(int argc, char **argv)
+{
+	int n;
+
+	pids = xmalloc(1000000 * sizeof *pids);
+	for (n = 1000; n <= 1000000; n *= 10)
+		run(n);
+	return 0;
+}
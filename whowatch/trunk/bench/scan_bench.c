@@ -0,0 +1,110 @@
+/*
+ * Compare the /proc scanner with the readdir() based one it replaced.
+ * For each, time, allocations and system calls per scanned process
+ * are reported. With a directory made by mkfixture as the argument,
+ * its proc tree is scanned instead of the real one.
+ */
+#include "config.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "whowatch.h"
+#include "proctree.h"
+#include "machine.h"
+#include "bench.h"
+
+#define ITERATIONS	20
+
+static unsigned long nproc;
+
+static void count(struct pinfo *i, void *unused)
+{
+	nproc++;
+}
+
+/*
+ * Scanner as it was before getdents64()/openat(): readdir(),
+ * full path for every process and a read of the first 63 bytes.
+ * With with_uid set, the owner is also taken by stat() on
+ * /proc/<pid>, so the same data as in the snapshot is gathered.
+ */
+static void legacy_scan(int with_uid)
+{
+	char name[PATH_MAX];
+	struct dirent *e;
+	struct stat st;
+	char buf[64];
+	DIR *d;
+	int f, n;
+
+	if (!(d = opendir(proc_dir))) return;
+	while ((e = readdir(d))) {
+		if (!isdigit(e->d_name[0])) continue;
+		if (with_uid) {
+			snprintf(name, sizeof name, "%s/%s", proc_dir,
+				 e->d_name);
+			stat(name, &st);
+		}
+		snprintf(name, sizeof name, "%s/%s/stat", proc_dir, e->d_name);
+		if ((f = open(name, 0)) == -1) continue;
+		n = read(f, buf, 63);
+		close(f);
+		if (n <= 0) continue;
+		nproc++;
+	}
+	closedir(d);
+}
+
+static void readdir_scan(void *unused)
+{
+	legacy_scan(0);
+}
+
+static void readdir_stat_scan(void *unused)
+{
+	legacy_scan(1);
+}
+
+static void scan(void *unused)
+{
+	for_each_pinfo(count, 0);
+}
+
+static void run(const char *name, void (*fn)(void *))
+{
+	nproc = 0;
+	fn(0);			/* warm up, opens /proc if needed */
+	if (!nproc) {
+		bench_report(name, "procs=0");
+		return;
+	}
+	bench_ops(name, 0, fn, 0, ITERATIONS, nproc, "procs=%lu", nproc);
+}
+
+int main(int argc, char **argv)
+{
+	char root[PATH_MAX];
+	struct scan_stats s;
+
+	if (argc > 1) {
+		snprintf(root, sizeof root, "%s/proc", argv[1]);
+		proc_dir = root;
+	}
+	run("scan.readdir", readdir_scan);
+	run("scan.readdir_stat", readdir_stat_scan);
+	run("scan.getdents", scan);
+	set_scanner("uring");
+	get_scan_stats(&s);
+	if (strcmp(s.backend, "uring"))
+		bench_report("scan.uring", "unsupported");
+	else run("scan.uring", scan);
+	return 0;
+}
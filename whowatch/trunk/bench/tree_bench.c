@@ -0,0 +1,273 @@
+/*
+ * Cost of what the process window does every tick: update_tree()
+ * taking a scan, delete_tree_lines() and synchronize() giving lines
+ * to the processes that came and went, tree_string() for every
+ * line, proc_match() testing all lines and finding nothing,
+ * echo_line() and draw_tree() filling a screen, and filter_lines()
+ * giving lines to one user's processes, per process in the tree.
+ *
+ * The processes are made up, 1k to 100k of them with 1% replaced
+ * every round. With a directory made by mkfixture as the argument
+ * its proc tree is scanned instead, and nothing is replaced unless
+ * mkfixture -c is running. process.c is included to get at its
+ * static functions.
+ */
+#include "../src/process.c"
+
+#include <err.h>
+#include <limits.h>
+#include <stdio.h>
+
+#include "machine.h"
+#include "bench.h"
+
+#define ROUNDS		20
+#define SCREEN_ROWS	50
+#define SCREEN_COLS	200
+#define PATTERN		"^no such process$"
+#define FILTER		"user=1007 state=S"
+
+/* whowatch.c */
+struct window users_list, proc_win, history_win;
+struct window *current = &proc_win;
+int screen_rows = SCREEN_ROWS;
+char *line_buf;
+int buf_size;
+
+/* the rest of whowatch */
+bool replay_status(char *buf, size_t size) { return false; }
+void send_signal(int sig, pid_t pid) { }
+void sub_switch(void) { }
+void users_list_refresh(void) { }
+void pad_draw(void) { }
+void info_box(char *title, char *text) { }
+void set_search(char *s) { }
+void m_filter(void) { }
+unsigned int history_search(int l) { return -1; }
+
+struct synth
+{
+	struct pinfo i;
+	int parent;			/* its index			*/
+	int children;
+};
+
+static struct synth *procs;
+static int nprocs, next_pid, churn;
+static bool fixture;
+static char (*screen)[256];		/* lines for echo_line()	*/
+
+static void synth_scan(void (*func)(struct pinfo *, void *), void *data)
+{
+	int i;
+
+	for (i = 0; i < nprocs; i++)
+		func(&procs[i].i, data);
+}
+
+static char *synth_cmdline(struct pinfo *i)
+{
+	static char buf[64];
+
+	snprintf(buf, sizeof buf, "%s --worker %d", i->comm, i->pid);
+	return buf;
+}
+
+/* slot k gets a new process, a child of the one in slot parent */
+static void spawn(int k, int parent)
+{
+	static const char *names[] = {
+		"bash", "sshd", "python3", "nginx", "postgres", "make"
+	};
+	struct synth *s = &procs[k];
+
+	memset(s, 0, sizeof *s);
+	s->i.pid = next_pid++;
+	s->i.ppid = parent < 0 ? 0 : procs[parent].i.pid;
+	s->i.tpgid = -1;
+	s->i.euid = 1000 + k % 50;
+	s->i.state = 'S';
+	snprintf(s->i.comm, sizeof s->i.comm, "%s",
+		 names[s->i.pid % (sizeof names / sizeof *names)]);
+	s->parent = parent;
+	if (parent >= 0) procs[parent].children++;
+}
+
+static void synth_init(int n)
+{
+	int k;
+
+	procs = xrealloc(procs, n * sizeof *procs);
+	nprocs = n;
+	next_pid = 1;
+	spawn(0, -1);				/* init */
+	for (k = 1; k < n; k++)
+		spawn(k, random() % k);
+	churn = n / 100;
+}
+
+/* childless processes exit and new ones start under random parents */
+static void replace(void)
+{
+	int c, j, p;
+
+	if (fixture) return;
+	for (c = 0; c < churn; c++) {
+		do j = 1 + random() % (nprocs - 1);
+		while (procs[j].children);
+		procs[procs[j].parent].children--;
+		do p = random() % nprocs;
+		while (p == j);
+		spawn(j, p);
+	}
+}
+
+/* update_lines() without the profiling */
+static void lines_sync(void)
+{
+	delete_tree_lines();
+	if (filter_on()) filter_lines();
+	else synchronize();
+}
+
+static void before_update(void *unused)
+{
+	lines_sync();
+	replace();
+}
+
+static void update(void *unused)
+{
+	update_tree(mark_del);
+}
+
+static void before_lines(void *unused)
+{
+	replace();
+	update_tree(mark_del);
+}
+
+static void new_lines(void *unused)
+{
+	lines_sync();
+}
+
+/* a whole tick, so prefixes are dropped as they are in use */
+static void tick(void *unused)
+{
+	replace();
+	update_tree(mark_del);
+	lines_sync();
+}
+
+static void strings(void *unused)
+{
+	char buf[TREE_STRING_SZ];
+	struct proc_t *p;
+
+	for (p = tree_start(tree_root, tree_root); p; p = tree_next())
+		tree_string(tree_root, p, buf);
+}
+
+/* what a new pattern costs, 'n' without a change is only a lookup */
+static void search(void *unused)
+{
+	search_forget();
+	do_search(PATTERN);
+}
+
+static void echo_screen(void *unused)
+{
+	int l;
+
+	for (l = 0; l < SCREEN_ROWS; l++)
+		echo_line(&proc_win, screen[l], l);
+}
+
+static void draw(void *unused)
+{
+	draw_tree();
+}
+
+static bool screen_init(void)
+{
+	FILE *null = fopen("/dev/null", "w");
+
+	if (!null || !newterm("xterm", null, stdin)) return false;
+	start_color();
+	screen_cols = SCREEN_COLS;
+	win_init();
+	proc_win.wd = newwin(SCREEN_ROWS, SCREEN_COLS, 0, 0);
+	screen = xcalloc(SCREEN_ROWS, sizeof *screen);
+	return true;
+}
+
+static void run(int n, bool drawn)
+{
+	int l;
+
+	if (!fixture) synth_init(n);
+	update_tree(mark_del);
+	lines_sync();
+	n = proc_win.d_lines;
+
+	bench_ops("tree.update", before_update, update, 0, ROUNDS, n,
+		  "procs=%d", n);
+	if (!fixture)
+		bench_ops("tree.lines", before_lines, new_lines, 0, ROUNDS,
+			  churn, "procs=%d replaced=%d", n, churn);
+	bench_ops("tree.string", tick, strings, 0, ROUNDS,
+		  proc_win.d_lines, "procs=%d", n);
+	bench_ops("tree.search", 0, search, 0, ROUNDS, proc_win.d_lines,
+		  "procs=%d", n);
+	filter_set(FILTER, 0, 0);
+	clear_list();
+	lines_sync();
+	bench_ops("tree.filter", before_lines, new_lines, 0, ROUNDS, n,
+		  "procs=%d shown=%d", n, proc_win.d_lines);
+	filter_set("", 0, 0);
+	clear_list();
+	lines_sync();
+	if (drawn) {
+		for (l = 0; l < SCREEN_ROWS; l++)
+			snprintf(screen[l], sizeof *screen, "%s",
+				 proc_give_line(l) ? line_buf : "");
+		bench_ops("screen.echo_line", 0, echo_screen, 0, ROUNDS * 50,
+			  SCREEN_ROWS, "rows=%d", SCREEN_ROWS);
+		bench_ops("tree.draw", 0, draw, 0, ROUNDS * 50,
+			  proc_win.rows, "procs=%d rows=%d", n,
+			  proc_win.rows);
+	}
+
+	if (fixture) return;
+	/* everything goes away before the next size */
+	nprocs = 0;
+	update_tree(mark_del);
+	delete_tree_lines();
+	clear_list();
+}
+
+int main(int argc, char **argv)
+{
+	char root[PATH_MAX];
+	bool drawn;
+	int n;
+
+	buf_size = 256;
+	line_buf = xmalloc(buf_size);
+	proc_win.match = proc_match;
+	drawn = screen_init();
+	if (!drawn) warnx("no terminal, screen is not measured");
+	if (argc > 1) {
+		snprintf(root, sizeof root, "%s/proc", argv[1]);
+		proc_dir = root;
+		fixture = true;
+		run(0, drawn);
+	} else {
+		tree_source(synth_scan, synth_cmdline);
+		for (n = 1000; n <= 100000; n *= 10)
+			run(n, drawn);
+	}
+	if (drawn) endwin();
+	return 0;
+}
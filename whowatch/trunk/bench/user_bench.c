@@ -0,0 +1,272 @@
+/*
+ * Cost of the users list at 1k to 50k sessions. The sessions are
+ * read from a synthetic utmp file, then logged out and in again
+ * through the wtmp record handler, while the line under the cursor
+ * is looked up, screens are redrawn and the last column of a screen
+ * is brought up to date as it is every tick. Then the same logins
+ * and logouts are written to a wtmp file and taken by check_wtmp().
+ * None of it should grow with the number of sessions. user.c is
+ * included to get at its static functions, the screen and /proc
+ * parts are stubbed out.
+ */
+#include "../src/user.c"
+
+#include <err.h>
+#include <fcntl.h>
+
+#include "bench.h"
+
+#define MAX_SESSIONS	50000
+#define ROUNDS		3
+#define LOOKUPS		1000000		/* per round			*/
+#define REDRAWS		10000
+#define ROWS		50
+#define BATCH		16		/* wtmp records between ticks	*/
+
+struct window users_list, proc_win, history_win, info_win;
+struct window *current = &users_list;
+WINDOW *main_win;
+int screen_cols = 200;
+
+static char scratch[64];
+
+/* screen.c, only what decides which lines are drawn */
+bool below(int l, struct window *w) { return l > w->offset + (int) w->rows; }
+bool above(int l, struct window *w) { return l < w->offset; }
+bool outside(int l, struct window *w) { return above(l, w) || below(l, w); }
+int print_line(struct window *w, const char *s, int line, bool virtual) { return 1; }
+int echo_line(struct window *w, const char *s, int line) { return 0; }
+void delete_line(struct window *w, int line) { }
+void cursor_on(struct window *w, int line) { }
+void cursor_off(struct window *w, int line) { }
+void print_help(void) { }
+
+/* procinfo.c, the foreground command changes every 16 ticks */
+int get_ppid(int pid) { return 1; }
+char *get_name(int pid) { return "sshd"; }
+
+bool get_pinfo(int pid, struct pinfo *i)
+{
+	i->pid = pid;
+	i->tpgid = pid + 1;
+	return true;
+}
+
+char *cmdline_lookup(struct pinfo *i)
+{
+	snprintf(scratch, sizeof scratch, "vi notes.%llu", ticks / 16);
+	return scratch;
+}
+
+/* the rest of whowatch */
+bool reg_match(const char *s) { return false; }
+void loop_add_fd(int fd, void (*func)(int fd, void *data), void *data) { }
+void refresh_screen(void) { }
+void show_tree(pid_t pid) { }
+void tree_title(struct user_t *u) { }
+void show_history(void) { }
+void sub_switch(void) { }
+void pad_draw(void) { }
+
+static struct utmpx *records;
+static const char *wtmp_path;
+static int *order, sessions, written;
+
+static void make_record(struct utmpx *u, int i, short type)
+{
+	memset(u, 0, sizeof *u);
+	u->ut_type = type;
+	u->ut_pid = 1000 + i;
+	snprintf(u->ut_line, sizeof u->ut_line, "pts/%d", i);
+	snprintf(u->ut_user, sizeof u->ut_user, "user%d", i % 500);
+#ifdef HAVE_STRUCT_UTMPX_UT_HOST
+	snprintf(u->ut_host, sizeof u->ut_host, "10.0.%d.%d", i / 250, i % 250);
+#endif
+}
+
+/* a utmp file with n logged in users */
+static void write_utmp(const char *path, int n)
+{
+	int fd, i;
+
+	for (i = 0; i < n; i++)
+		make_record(&records[i], i, USER_PROCESS);
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) == -1)
+		err(EXIT_FAILURE, "%s", path);
+	if (write(fd, records, n * sizeof *records) != n * sizeof *records)
+		err(EXIT_FAILURE, "%s", path);
+	close(fd);
+}
+
+/*
+ * BATCH more records in wtmp, all sessions log out in scattered
+ * order and then in again.
+ */
+static void append_wtmp(void *unused)
+{
+	struct utmpx u[BATCH];
+	int fd, i;
+
+	for (i = 0; i < BATCH; i++, written++)
+		make_record(&u[i], order[written % sessions],
+			    written / sessions % 2 ? USER_PROCESS : DEAD_PROCESS);
+	if ((fd = open(wtmp_path, O_WRONLY | O_APPEND)) == -1 ||
+	    write(fd, u, sizeof u) != sizeof u)
+		err(EXIT_FAILURE, "%s", wtmp_path);
+	close(fd);
+}
+
+static void read_new(void *unused)
+{
+	check_wtmp();
+}
+
+static void clear_users(void *unused)
+{
+	struct user_t *u;
+
+	while ((u = node_user(os_first(&lines))))
+		del_user(u);
+}
+
+static void load(void *path)
+{
+	utmpname(path);
+	setutxent();
+	read_utmp();
+	endutxent();
+}
+
+static void reload(void *path)
+{
+	clear_users(0);
+	load(path);
+}
+
+static void lookup(void *unused)
+{
+	int i;
+
+	for (i = 0; i < LOOKUPS; i++) {
+		users_list.offset = order[i % sessions] / ROWS * ROWS;
+		users_list.cursor = order[i % sessions] % ROWS;
+		if (!cursor_user()) abort();
+	}
+}
+
+static void redraw(void *unused)
+{
+	int i;
+
+	for (i = 0; i < REDRAWS; i++) {
+		users_list.offset = order[i % sessions] / ROWS * ROWS;
+		users_list_refresh();
+	}
+}
+
+static void tick(void *unused)
+{
+	int i;
+
+	users_list.offset = 0;
+	for (i = 0; i < REDRAWS; i++) {
+		ticks++;
+		periodic();
+	}
+}
+
+/* records[] in scattered order, all of one type */
+static void make_records(short type)
+{
+	int i;
+
+	for (i = 0; i < sessions; i++)
+		make_record(&records[i], order[i], type);
+}
+
+static void before_logout(void *path)
+{
+	reload(path);
+	make_records(DEAD_PROCESS);
+}
+
+static void before_login(void *unused)
+{
+	clear_users(0);
+	make_records(USER_PROCESS);
+}
+
+static void take_records(void *unused)
+{
+	bool changed;
+	int i;
+
+	for (i = 0; i < sessions; i++)
+		wtmp_record(&records[i], &changed);
+}
+
+static void run(char *path, int n)
+{
+	int i, fd;
+
+	write_utmp(path, n);
+	order = xmalloc(n * sizeof *order);
+	sessions = n;
+	for (i = 0; i < n; i++)
+		order[i] = (i * 7919L) % n;
+
+	bench_ops("users.load", clear_users, load, path, ROUNDS, n,
+		  "sessions=%d", n);
+	if (users_list.d_lines != n) errx(EXIT_FAILURE, "read %d of %d",
+					  users_list.d_lines, n);
+
+	users_list.rows = ROWS;
+	bench_ops("users.lookup", 0, lookup, 0, ROUNDS, LOOKUPS,
+		  "sessions=%d", n);
+	bench_ops("users.redraw", 0, redraw, 0, ROUNDS, REDRAWS,
+		  "sessions=%d rows=%d", n, ROWS);
+	bench_ops("users.tick", 0, tick, 0, ROUNDS, REDRAWS,
+		  "sessions=%d", n);
+
+	/* everybody logs out in scattered order, then in again */
+	bench_ops("users.logout", before_logout, take_records, path, ROUNDS,
+		  n, "sessions=%d", n);
+	if (users_list.d_lines) errx(EXIT_FAILURE, "%d left",
+				     users_list.d_lines);
+	bench_ops("users.login", before_login, take_records, 0, ROUNDS, n,
+		  "sessions=%d", n);
+
+	if ((fd = open(wtmp_path, O_WRONLY | O_TRUNC)) == -1)
+		err(EXIT_FAILURE, "%s", wtmp_path);
+	close(fd);
+	wtmp_open(wtmp_path);
+	written = 0;
+	bench_ops("users.wtmp", append_wtmp, read_new, 0, 2 * n / BATCH,
+		  BATCH, "sessions=%d batch=%d", n, BATCH);
+	if (users_list.d_lines != n) errx(EXIT_FAILURE, "%d of %d back",
+					  users_list.d_lines, n);
+
+	clear_users(0);
+	free(order);
+}
+
+int main(int argc, char **argv)
+{
+	char path[] = "/tmp/user_bench.XXXXXX";
+	char wtmp[] = "/tmp/user_bench.XXXXXX";
+	int fd;
+
+	if ((fd = mkstemp(path)) == -1 || close(fd) ||
+	    (fd = mkstemp(wtmp)) == -1 || close(fd))
+		err(EXIT_FAILURE, "mkstemp");
+	wtmp_path = wtmp;
+	buf_size = 256;
+	line_buf = xmalloc(buf_size);
+	records = xmalloc(MAX_SESSIONS * sizeof *records);
+	run(path, 1000);
+	run(path, 10000);
+	run(path, MAX_SESSIONS);
+	unlink(path);
+	unlink(wtmp);
+	return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * Batch mode: no curses, every tick the users and the process tree
+ * are written to stdout as NDJSON, one object per line, or as CSV.
+ * Each record has a type (user, proc or tick) and the number of the
+ * tick it belongs to. The tick record comes last and tells how much
+ * CPU time and wall time the snapshot took.
+ */
+#include "config.h"
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "whowatch.h"
+#include "proctree.h"
+
+static bool csv;
+static long count;			/* snapshots to write, 0 for no end */
+static long written;
+
+static const char *csv_header[] = {
+	"#user,tick,name,tty,host,pid,parent,idle,what",
+	"#proc,tick,pid,ppid,depth,state,uid,cmd",
+	"#tick,tick,time,users,procs,cpu_usec,wall_usec",
+};
+
+/*
+ * Length of the UTF-8 sequence at s, 0 if it is not a valid one.
+ * Overlong forms, surrogates and code points above U+10FFFF are
+ * not valid.
+ */
+static int utf8_len(const unsigned char *s)
+{
+	unsigned char lo = 0x80, hi = 0xbf;
+	int n, k;
+
+	if (*s >= 0xc2 && *s <= 0xdf) n = 2;
+	else if (*s >= 0xe0 && *s <= 0xef) n = 3;
+	else if (*s >= 0xf0 && *s <= 0xf4) n = 4;
+	else return 0;
+	if (*s == 0xe0) lo = 0xa0;
+	if (*s == 0xed) hi = 0x9f;
+	if (*s == 0xf0) lo = 0x90;
+	if (*s == 0xf4) hi = 0x8f;
+	if (s[1] < lo || s[1] > hi) return 0;
+	for (k = 2; k < n; k++)
+		if ((s[k] & 0xc0) != 0x80) return 0;
+	return n;
+}
+
+static void put_string(const char *s)
+{
+	int n;
+
+	if (csv) {
+		if (!s[strcspn(s, ",\"\r\n")]) {
+			fputs(s, stdout);
+			return;
+		}
+		putchar('"');
+		for (; *s; s++) {
+			if (*s == '"') putchar('"');
+			putchar(*s);
+		}
+		putchar('"');
+		return;
+	}
+	/* command lines are bytes, not always UTF-8 */
+	putchar('"');
+	for (; *s; s++) {
+		unsigned char c = *s;
+
+		if (c == '"' || c == '\\') {
+			putchar('\\');
+			putchar(c);
+		} else if (c < 0x20) {
+			printf("\\u%04x", c);
+		} else if (c < 0x80) {
+			putchar(c);
+		} else if ((n = utf8_len((const unsigned char *) s))) {
+			fwrite(s, 1, n, stdout);
+			s += n - 1;
+		} else printf("\\u%04x", c);
+	}
+	putchar('"');
+}
+
+static void begin(const char *type)
+{
+	if (csv) fputs(type, stdout);
+	else printf("{\"type\":\"%s\"", type);
+}
+
+static void key(const char *name)
+{
+	if (csv) putchar(',');
+	else printf(",\"%s\":", name);
+}
+
+static void field_str(const char *name, const char *s)
+{
+	key(name);
+	put_string(s);
+}
+
+static void field_num(const char *name, long long n)
+{
+	key(name);
+	printf("%lld", n);
+}
+
+static void end(void)
+{
+	fputs(csv ? "\n" : "}\n", stdout);
+}
+
+static void put_user(struct user_t *u, void *unused)
+{
+	begin("user");
+	field_num("tick", ticks);
+	field_str("name", u->name);
+	field_str("tty", u->tty);
+	field_str("host", u->host);
+	field_num("pid", u->pid);
+	field_str("parent", u->parent);
+	field_str("idle", u->idle);
+	field_str("what", u->what);
+	end();
+}
+
+static int put_procs(void)
+{
+	struct proc_t *p;
+	struct pinfo *i;
+	int n = 0;
+
+	for (p = tree_start(0, 0); p; p = tree_next(), n++) {
+		i = &p->info;
+		begin("proc");
+		field_num("tick", ticks);
+		field_num("pid", p->pid);
+		field_num("ppid", i->ppid);
+		field_num("depth", tree_depth() - 1);	/* init is 0 */
+		key("state");
+		printf(csv ? "%c" : "\"%c\"", i->state);
+		field_num("uid", i->euid);
+		field_str("cmd", tree_cmdline(i));
+		end();
+	}
+	return n;
+}
+
+static long long usec(struct timeval *tv)
+{
+	return tv->tv_sec * 1000000LL + tv->tv_usec;
+}
+
+static long long cpu_usec(void)
+{
+	struct rusage r;
+
+	getrusage(RUSAGE_SELF, &r);
+	return usec(&r.ru_utime) + usec(&r.ru_stime);
+}
+
+static long long wall_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void no_del(void *unused)
+{
+}
+
+/*
+ * Called by the main loop, n ticks have passed since the last call.
+ */
+void batch_tick(unsigned long long n)
+{
+	long long cpu = cpu_usec(), wall = wall_usec();
+	int users, procs;
+
+	ticks += n;
+	prof_begin(PROF_TICK);
+	check_wtmp();
+	if (tree_stale()) update_tree(no_del);
+	tree_pending_clear();
+	users = users_for_each(put_user, 0);
+	procs = put_procs();
+	record_tick();
+	prof_end(PROF_TICK);
+
+	begin("tick");
+	field_num("tick", ticks);
+	field_num("time", time(0));
+	field_num("users", users);
+	field_num("procs", procs);
+	field_num("cpu_usec", cpu_usec() - cpu);
+	field_num("wall_usec", wall_usec() - wall);
+	end();
+	if (fflush(stdout) == EOF)
+		err(EXIT_FAILURE, "stdout");
+	if (count && ++written == count)
+		exit(EXIT_SUCCESS);
+}
+
+/*
+ * Format is "json" or "csv", returns false for anything else.
+ */
+bool batch_init(const char *format, long n)
+{
+	int i;
+
+	if (!strcmp(format, "csv")) csv = true;
+	else if (strcmp(format, "json")) return false;
+	count = n;
+	setvbuf(stdout, 0, _IOFBF, 64 * 1024);
+	if (csv)
+		for (i = 0; i < sizeof csv_header / sizeof *csv_header; i++)
+			puts(csv_header[i]);
+	return true;
+}
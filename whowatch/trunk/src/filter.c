@@ -0,0 +1,233 @@
+/*
+ * Filter of the process tree. An expression like
+ *
+ *	user=build state=R cmd~java rss>1G
+ *
+ * is a list of terms that all have to hold. It is compiled once
+ * into an array of tests, the cheap ones first, so the command line
+ * is only looked at for processes that passed the rest. process.c
+ * gives lines only to the processes that match and their ancestors.
+ *
+ *	user=NAME user!=NAME	owner, a name or a uid
+ *	state=RD state!=S	one of the state letters
+ *	cmd~RE cmd!~RE		command line, extended regular expression
+ *	rss>N rss<N		resident size, N in kB or with K, M or G
+ */
+#include "config.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <pwd.h>
+#include <regex.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "whowatch.h"
+#include "proctree.h"
+
+#define MAX_TERMS	16
+
+enum field { F_USER, F_STATE, F_RSS, F_CMD };	/* in order of cost */
+
+struct term
+{
+	enum field field;
+	char op;			/* '=', '~', '>' or '<'		*/
+	bool not;
+	union {
+		int uid;
+		char states[16];
+		unsigned long long kb;
+		regex_t *re;
+	} v;
+};
+
+static struct term terms[MAX_TERMS];
+static int nterms;
+static char text[128];			/* as it was given		*/
+
+static const struct
+{
+	const char *name;
+	enum field field;
+	const char *ops;		/* allowed, '!' before = and ~	*/
+} fields[] = {
+	{ "user", F_USER, "=" },
+	{ "state", F_STATE, "=" },
+	{ "rss", F_RSS, "<>" },
+	{ "cmd", F_CMD, "~" },
+};
+
+static void free_terms(struct term *t, int n)
+{
+	while (n--)
+		if (t[n].field == F_CMD) {
+			regfree(t[n].v.re);
+			free(t[n].v.re);
+		}
+}
+
+static int cmp_cost(const void *a, const void *b)
+{
+	const struct term *x = a, *y = b;
+
+	return x->field - y->field;
+}
+
+/*
+ * "1G", "512M", "300K" or "300", which is in kB as well. False if
+ * it is not one of those or too large.
+ */
+static bool parse_size(const char *s, unsigned long long *kb)
+{
+	int shift = 0;
+	char *end;
+
+	if (!isdigit((unsigned char) *s)) return false;
+	errno = 0;
+	*kb = strtoull(s, &end, 10);
+	if (errno == ERANGE) return false;
+	switch (toupper((unsigned char) *end)) {
+	case 'G': shift += 10;		/* fall through */
+	case 'M': shift += 10;		/* fall through */
+	case 'K': end++;
+	}
+	if (*kb > ULLONG_MAX >> shift) return false;
+	*kb <<= shift;
+	return !*end;
+}
+
+static bool parse_term(char *s, struct term *t, char *err, size_t size)
+{
+	char *op = s + strcspn(s, "!=~<>");
+	struct passwd *pw;
+	char *value, *end;
+	int i, e;
+
+	for (i = 0; i < sizeof fields / sizeof *fields; i++)
+		if (strlen(fields[i].name) == op - s &&
+		    !strncmp(s, fields[i].name, op - s))
+			break;
+	if (i == sizeof fields / sizeof *fields) {
+		snprintf(err, size, "unknown field in %s", s);
+		return false;
+	}
+	memset(t, 0, sizeof *t);
+	t->field = fields[i].field;
+	t->not = *op == '!';
+	t->op = op[t->not];
+	value = op + t->not + 1;
+	if (!t->op || !strchr(fields[i].ops, t->op) ||
+	    (t->not && t->op != '=' && t->op != '~')) {
+		snprintf(err, size, "bad operator in %s", s);
+		return false;
+	}
+	if (!*value) {
+		snprintf(err, size, "no value in %s", s);
+		return false;
+	}
+	switch (t->field) {
+	case F_USER:
+		if ((pw = getpwnam(value))) t->v.uid = pw->pw_uid;
+		else {
+			t->v.uid = strtol(value, &end, 10);
+			if (*end) {
+				snprintf(err, size, "no user %s", value);
+				return false;
+			}
+		}
+		break;
+	case F_STATE:
+		snprintf(t->v.states, sizeof t->v.states, "%s", value);
+		break;
+	case F_RSS:
+		if (!parse_size(value, &t->v.kb)) {
+			snprintf(err, size, "bad size in %s", s);
+			return false;
+		}
+		break;
+	case F_CMD:
+		t->v.re = xmalloc(sizeof *t->v.re);
+		e = regcomp(t->v.re, value, REG_EXTENDED | REG_NOSUB);
+		if (e) {
+			regerror(e, t->v.re, err, size);
+			free(t->v.re);
+			return false;
+		}
+		break;
+	}
+	return true;
+}
+
+/*
+ * Make expr the filter, an empty one turns it off. The old filter
+ * stays if expr is not valid, the reason is in err then.
+ */
+bool filter_set(const char *expr, char *err, size_t size)
+{
+	struct term new[MAX_TERMS];
+	char buf[sizeof text], *s, *save;
+	int n = 0;
+
+	if (strlen(expr) >= sizeof buf) {
+		snprintf(err, size, "expression too long");
+		return false;
+	}
+	snprintf(buf, sizeof buf, "%s", expr);
+	for (s = strtok_r(buf, " \t", &save); s; s = strtok_r(0, " \t", &save)) {
+		if (n == MAX_TERMS) {
+			snprintf(err, size, "more than %d terms", MAX_TERMS);
+			free_terms(new, n);
+			return false;
+		}
+		if (!parse_term(s, &new[n], err, size)) {
+			free_terms(new, n);
+			return false;
+		}
+		n++;
+	}
+	qsort(new, n, sizeof *new, cmp_cost);
+	free_terms(terms, nterms);
+	memcpy(terms, new, n * sizeof *new);
+	nterms = n;
+	snprintf(text, sizeof text, "%s", n ? expr : "");
+	return true;
+}
+
+bool filter_on(void)
+{
+	return nterms != 0;
+}
+
+/*
+ * The expression, "" if there is none.
+ */
+char *filter_text(void)
+{
+	return text;
+}
+
+static bool test(struct term *t, struct pinfo *i)
+{
+	switch (t->field) {
+	case F_USER:
+		return i->euid == t->v.uid;
+	case F_STATE:
+		return i->state && strchr(t->v.states, i->state);
+	case F_RSS:
+		return t->op == '>' ? i->rss > t->v.kb : i->rss < t->v.kb;
+	case F_CMD:
+		return !regexec(t->v.re, tree_cmdline(i), 0, 0, 0);
+	}
+	return false;
+}
+
+bool filter_match(struct pinfo *i)
+{
+	int k;
+
+	for (k = 0; k < nterms; k++)
+		if (test(&terms[k], i) == terms[k].not) return false;
+	return true;
+}
@@ -18,7 +18,9 @@ static void general(void)
 	title("d"); println(" - user or process details");
 	title("s"); println(" - system information");
 	title("t"); println(" - tree of all processes");
-	title("/"); println(" - search");
+	title("/"); println(" - search as you type");
+	title("n N"); println(" - next, previous match");
+	title("p"); println(" - toggle own cost in the help line");
 	println("");
 }
 
@@ -28,6 +30,14 @@ static void userwin_help(void)
 	title("ENTER"); println(" - selected user processes");
 	title("i"); println(" - toggle users idle time");
 	title("c"); println(" - toggle long command line");
+	title("h"); println(" - login history");
+}
+
+static void historywin_help(void)
+{
+	title("LOGIN HISTORY:\n"); newln();
+	title("ENTER"); println(" - go back to user list");
+	title("h"); println(" - go back to user list");
 }
 
 static void procwin_help(void)
@@ -37,9 +47,21 @@ static void procwin_help(void)
 	title("l"); println(" - choose from signal list");
 	title("o"); println(" - toggle process owner");
 	title("c"); println(" - toggle long command line");
+	title("f"); println(" - filter, e.g. user=build cmd~java rss>1G");
+	title("F"); println(" - no filter");
 	title("^K"); println(" - send KILL signal");
 }
 	
+static void replay_help(void)
+{
+	println("");
+	title("REPLAY:\n"); newln();
+	title("space"); println(" - pause or go on");
+	title("+ -"); println(" - faster, slower");
+	title("< >"); println(" - a minute back, forward");
+	title("[ ]"); println(" - ten minutes back, forward");
+}
+
 static void sub_help(void)
 {
 	println("");
@@ -52,10 +74,12 @@ static void sub_help(void)
 
 static void show_help(void *unused)
 {
-	dolog("%s: printing help\n", __FUNCTION__);
+	trace_event(TR_HELP, 0, 0, 0);
 	general();
 	if(current == &users_list) userwin_help();
 	if(current == &proc_win) procwin_help();	
+	if(current == &history_win) historywin_help();
+	if(replay_active()) replay_help();
 	sub_help();
 }
 
@@ -0,0 +1,291 @@
+/*
+ * Login history. Sessions are put together from wtmp read backwards,
+ * so the newest come first, and the file is read only as far as
+ * the window has been scrolled. Going back in time a logout record
+ * is seen before the login on the same tty, so logouts wait in
+ * a small table until their login turns up.
+ */
+#include "config.h"
+
+#ifdef HAVE_UTMP_H
+#include <utmp.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "whowatch.h"
+
+enum end { STILL, LOGOUT, GONE, DOWN };
+
+struct session
+{
+	struct user_t u;		/* who and where		*/
+	time_t login;
+	time_t logout;
+	enum end end;
+};
+
+struct pending
+{
+	char tty[member_size(struct utmpx, ut_line) + 1];
+	time_t time;
+	enum end end;
+};
+
+static struct session *sessions;
+static int nsessions, max_sessions;
+static struct pending *pending;		/* ttys with a known end	*/
+static int npending, max_pending;
+static time_t boot;			/* earliest boot seen so far	*/
+static bool at_start;			/* whole file has been read	*/
+
+static struct pending *find_pending(const char *tty)
+{
+	int i;
+
+	for (i = 0; i < npending; i++)
+		if (!strcmp(pending[i].tty, tty)) return &pending[i];
+	return 0;
+}
+
+/*
+ * The next login on tty (the previous one read) ended at t.
+ */
+static void set_pending(const char *tty, time_t t, enum end end)
+{
+	struct pending *p;
+
+	if (!(p = find_pending(tty))) {
+		if (npending == max_pending) {
+			max_pending = max_pending ? max_pending * 2 : 16;
+			pending = xrealloc(pending, max_pending * sizeof *pending);
+		}
+		p = &pending[npending++];
+		strcpy(p->tty, tty);
+	}
+	p->time = t;
+	p->end = end;
+}
+
+static void add_session(struct utmpx *ut, const char *tty)
+{
+	struct session *s;
+	struct pending *p;
+
+	if (nsessions == max_sessions) {
+		max_sessions = max_sessions ? max_sessions * 2 : 256;
+		sessions = xrealloc(sessions, max_sessions * sizeof *sessions);
+	}
+	s = &sessions[nsessions];
+	memset(s, 0, sizeof *s);
+	strncpy(s->u.name, ut->ut_user, sizeof ut->ut_user);
+	strcpy(s->u.tty, tty);
+#ifdef HAVE_STRUCT_UTMPX_UT_HOST
+	strncpy(s->u.host, ut->ut_host, sizeof ut->ut_host);
+#endif
+	s->u.pid = ut->ut_pid;
+	nsessions++;
+	s->login = ut->ut_tv.tv_sec;
+	if ((p = find_pending(tty))) {
+		s->logout = p->time;
+		s->end = p->end;
+	} else if (boot) {
+		s->logout = boot;
+		s->end = DOWN;
+	}
+	/* an older login on this tty without a logout was lost */
+	set_pending(tty, s->login, GONE);
+}
+
+static void record(struct utmpx *ut)
+{
+	char tty[member_size(struct utmpx, ut_line) + 1];
+
+	strncpy(tty, ut->ut_line, sizeof tty - 1);
+	tty[sizeof tty - 1] = 0;
+	switch (ut->ut_type) {
+	case USER_PROCESS:
+		if (*tty && *ut->ut_user) add_session(ut, tty);
+		break;
+	case DEAD_PROCESS:
+		if (*tty) set_pending(tty, ut->ut_tv.tv_sec, LOGOUT);
+		break;
+#ifdef RUN_LVL
+	case RUN_LVL:
+		if (strncmp(ut->ut_user, "shutdown", sizeof ut->ut_user))
+			break;
+		/* fall through */
+#endif
+	case BOOT_TIME:
+		/* logouts seen so far belong to later boots */
+		npending = 0;
+		boot = ut->ut_tv.tv_sec;
+		break;
+	}
+}
+
+static void history_info(void)
+{
+	char buf[128], when[32];
+
+	werase(info_win.wd);
+	if (nsessions) {
+		strftime(when, sizeof when, "%b %e %H:%M",
+			 localtime(&sessions[nsessions - 1].login));
+		snprintf(buf, sizeof buf, "\x1login history: %d%s sessions "
+			 "since %s", nsessions, at_start ? "" : "+", when);
+	} else snprintf(buf, sizeof buf, "\x1login history: no sessions");
+	echo_line(&info_win, buf, 0);
+	wnoutrefresh(info_win.wd);
+}
+
+/*
+ * Read wtmp back until there are n sessions or the file has ended.
+ */
+static void load(int n)
+{
+	struct utmpx *ut;
+	int old = nsessions;
+
+	while (nsessions < n && !at_start) {
+		if ((ut = wtmp_back())) {
+			record(ut);
+			continue;
+		}
+		at_start = true;
+		wtmp_back_close();
+	}
+	history_win.d_lines = nsessions;
+	if (nsessions != old) history_info();
+}
+
+/*
+ * Keep a page more than what is shown, so that the cursor and
+ * page keys see there is something below.
+ */
+static void load_ahead(int line)
+{
+	load(line + 2 * (history_win.rows + 1));
+}
+
+static char *format(struct session *s)
+{
+	char login[16], end[32];
+	long d;
+
+	strftime(login, sizeof login, "%b %e %H:%M", localtime(&s->login));
+	if (s->end == STILL) {
+		snprintf(end, sizeof end, "still logged in");
+	} else {
+		d = (s->logout - s->login) / 60;
+		if (d < 0) d = 0;
+		if (s->end == LOGOUT)
+			strftime(end, sizeof end, "- %H:%M ", localtime(&s->logout));
+		else snprintf(end, sizeof end, "- %s ",
+			      s->end == DOWN ? "down " : "gone ");
+		if (d >= 24 * 60)
+			snprintf(end + strlen(end), sizeof end - strlen(end),
+				 "(%ld+%02ld:%02ld)", d / (24 * 60),
+				 d / 60 % 24, d % 60);
+		else snprintf(end + strlen(end), sizeof end - strlen(end),
+			      "(%02ld:%02ld)", d / 60, d % 60);
+	}
+	snprintf(line_buf, buf_size, USER_FORMAT,
+		 login, s->u.name, s->u.tty, s->u.host, end);
+	line_buf[buf_size - 1] = 0;
+	return line_buf;
+}
+
+static char *history_giveline(int line)
+{
+	load_ahead(line);
+	if (line >= nsessions) return 0;
+	return format(&sessions[line]);
+}
+
+static void history_refresh(void)
+{
+	int i;
+
+	load_ahead(history_win.offset);
+	wattrset(history_win.wd, A_BOLD);
+	for (i = history_win.offset; i < nsessions; i++) {
+		if (below(i, &history_win)) break;
+		print_line(&history_win, format(&sessions[i]), i, 0);
+	}
+}
+
+/*
+ * Start over from the current end of wtmp.
+ */
+void show_history(void)
+{
+	nsessions = npending = 0;
+	boot = 0;
+	at_start = !wtmp_back_open(wtmp_file);
+	history_win.offset = history_win.cursor = 0;
+	history_refresh();
+	history_info();
+}
+
+struct user_t *history_user(void)
+{
+	int line = history_win.cursor + history_win.offset;
+
+	if (line >= nsessions) return 0;
+	return &sessions[line].u;
+}
+
+/*
+ * Search goes on into older sessions until something matches.
+ */
+unsigned int history_search(int line)
+{
+	struct session *s;
+
+	for (;; line++) {
+		load(line + 1);
+		if (line >= nsessions) break;
+		s = &sessions[line];
+		if (reg_match(s->u.name) || reg_match(s->u.tty) ||
+		    reg_match(s->u.host) || reg_match(format(s)))
+			return line;
+	}
+	return -1;
+}
+
+static bool history_key(int key)
+{
+	switch (key) {
+	case KEY_ENTER:
+	case 'h':
+		wtmp_back_close();
+		werase(main_win);
+		current = &users_list;
+		print_help();
+		print_info();
+		users_list_refresh();
+		sub_switch();
+		pad_draw();
+		break;
+	default:
+		return KEY_SKIPPED;
+	}
+	return KEY_HANDLED;
+}
+
+/*
+ * Sessions are a snapshot taken by show_history().
+ */
+static void periodic(void)
+{
+}
+
+void history_init(void)
+{
+	history_win.giveme_line = history_giveline;
+	history_win.keys = history_key;
+	history_win.periodic = periodic;
+	history_win.redraw = history_refresh;
+}
@@ -15,6 +15,7 @@
 static char in[MAX_INPUT];	/* buffer for a input string 		*/
 static int pos;			/* current cursor position 		*/
 void (*call_back)(char *in);
+static void (*changed)(char *in);
 static unsigned short offset;
 static struct pad_t _box, _in;
 static char *descr, *title;
@@ -133,8 +134,11 @@ static int box_create(void)
 /* 
  * Create new input box. Callback function will be called
  * when ENTER is pressed with inbox input data as an argument.
+ * Edited, if not 0, is called after every change of the input
+ * and with 0 when the box is closed without callback.
  */
-void input_box(char *t, char *d, char *p, void (*callback)(char *in))
+void input_box(char *t, char *d, char *p, void (*callback)(char *in),
+	       void (*edited)(char *in))
 {
 	descr = d;
 	title = t;
@@ -143,6 +147,7 @@ void input_box(char *t, char *d, char *p, void (*callback)(char *in))
 	curs_set(2);
 	box_create();
 	call_back = callback;
+	changed = edited;
 }
 
 static void in_keys(int key)
@@ -161,6 +166,7 @@ static void in_keys(int key)
 		    (cur_button != CANCEL_BUTTON) && (pos != 0)) {
 		  call_back(in);
 		}
+		else if (changed) changed(0);
 		pos = 0;
 		offset = 0;
 		bzero(in, sizeof in);
@@ -171,6 +177,7 @@ static void in_keys(int key)
 		in[--pos] = 0;
 		mvwdelch(_in.wd, 0, pos);
 		if (offset != 0) offset--;
+		if (changed) changed(in);
 		break;
 	case KEY_TAB:
 		cur_button++;
@@ -182,6 +189,7 @@ static void in_keys(int key)
 		if(pos >= size) offset++;
 		in[pos++] = key;
 		waddch(_in.wd, key);
+		if (changed) changed(in);
 		break;
 	}
 }
@@ -0,0 +1,256 @@
+/*
+ * Main loop. Descriptors are registered with loop_add_fd() and their
+ * handlers are called when there is something to read. Ticks come
+ * from a timerfd and signals from a signalfd, so nothing is done
+ * between events. Systems without epoll use poll() with a pipe
+ * for signals.
+ */
+
+#include "config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "whowatch.h"
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H) && \
+    defined(HAVE_SYS_SIGNALFD_H)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#else
+#include <poll.h>
+#endif
+
+struct watch {
+	void (*func)(int fd, void *data);
+	void *data;
+};
+
+static struct watch *watches;		/* indexed by descriptor	*/
+static int nwatches;
+
+static void (*tick_func)(unsigned long long n);
+static void (*sig_func[NSIG])(int sig);
+static sigset_t sig_mask;
+static int interval;			/* tick length in seconds	*/
+
+static void set_watch(int fd, void (*func)(int fd, void *data), void *data)
+{
+	if (fd >= nwatches) {
+		int n = fd + 16;
+		watches = xrealloc(watches, n * sizeof *watches);
+		memset(watches + nwatches, 0, (n - nwatches) * sizeof *watches);
+		nwatches = n;
+	}
+	watches[fd].func = func;
+	watches[fd].data = data;
+}
+
+static void dispatch(int fd)
+{
+	if (fd < nwatches && watches[fd].func)
+		watches[fd].func(fd, watches[fd].data);
+}
+
+static void signal_caught(int sig)
+{
+	if (sig > 0 && sig < NSIG && sig_func[sig])
+		sig_func[sig](sig);
+}
+
+#ifdef USE_EPOLL
+
+static int ep_fd = -1;
+static int sig_fd = -1;
+
+static void timer_ready(int fd, void *unused)
+{
+	unsigned long long n;
+
+	if (read(fd, &n, sizeof n) == sizeof n && tick_func)
+		tick_func(n);
+}
+
+static void signal_ready(int fd, void *unused)
+{
+	struct signalfd_siginfo si;
+
+	while (read(fd, &si, sizeof si) == sizeof si)
+		signal_caught(si.ssi_signo);
+}
+
+static void loop_start(void)
+{
+	struct itimerspec its;
+	int fd;
+
+	if ((ep_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+		err(EXIT_FAILURE, "epoll_create1");
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd == -1)
+		err(EXIT_FAILURE, "timerfd_create");
+	memset(&its, 0, sizeof its);
+	its.it_value.tv_sec = its.it_interval.tv_sec = interval;
+	timerfd_settime(fd, 0, &its, 0);
+	loop_add_fd(fd, timer_ready, 0);
+}
+
+void loop_add_fd(int fd, void (*func)(int fd, void *data), void *data)
+{
+	struct epoll_event ev;
+
+	if (ep_fd == -1) loop_start();
+	memset(&ev, 0, sizeof ev);
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(ep_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+		err(EXIT_FAILURE, "epoll_ctl");
+	set_watch(fd, func, data);
+}
+
+void loop_del_fd(int fd)
+{
+	epoll_ctl(ep_fd, EPOLL_CTL_DEL, fd, 0);
+	set_watch(fd, 0, 0);
+}
+
+/*
+ * Deliver sig through the loop instead of a handler.
+ */
+void loop_signal(int sig, void (*func)(int sig))
+{
+	sig_func[sig] = func;
+	sigaddset(&sig_mask, sig);
+	sigprocmask(SIG_BLOCK, &sig_mask, 0);
+	if (sig_fd == -1) {
+		sig_fd = signalfd(-1, &sig_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+		if (sig_fd == -1)
+			err(EXIT_FAILURE, "signalfd");
+		loop_add_fd(sig_fd, signal_ready, 0);
+	} else {
+		signalfd(sig_fd, &sig_mask, 0);
+	}
+}
+
+void loop_run(void)
+{
+	struct epoll_event ev[16];
+	int i, n;
+
+	if (ep_fd == -1) loop_start();
+	for (;;) {
+		n = epoll_wait(ep_fd, ev, sizeof ev / sizeof *ev, -1);
+		if (n == -1 && errno != EINTR)
+			err(EXIT_FAILURE, "epoll_wait");
+		for (i = 0; i < n; i++)
+			dispatch(ev[i].data.fd);
+	}
+}
+
+#else /* !USE_EPOLL */
+
+static int sig_pipe[2] = { -1, -1 };
+
+static void sig_handler(int sig)
+{
+	unsigned char c = sig;
+	int e = errno;
+
+	write(sig_pipe[1], &c, 1);
+	errno = e;
+}
+
+static void signal_ready(int fd, void *unused)
+{
+	unsigned char c;
+
+	while (read(fd, &c, 1) == 1)
+		signal_caught(c);
+}
+
+void loop_add_fd(int fd, void (*func)(int fd, void *data), void *data)
+{
+	set_watch(fd, func, data);
+}
+
+void loop_del_fd(int fd)
+{
+	set_watch(fd, 0, 0);
+}
+
+void loop_signal(int sig, void (*func)(int sig))
+{
+	struct sigaction sa;
+
+	if (sig_pipe[0] == -1) {
+		if (pipe(sig_pipe) == -1)
+			err(EXIT_FAILURE, "pipe");
+		fcntl(sig_pipe[0], F_SETFL, O_NONBLOCK);
+		fcntl(sig_pipe[1], F_SETFL, O_NONBLOCK);
+		loop_add_fd(sig_pipe[0], signal_ready, 0);
+	}
+	sig_func[sig] = func;
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = sig_handler;
+	sa.sa_flags = SA_RESTART;
+	sigaction(sig, &sa, 0);
+}
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+void loop_run(void)
+{
+	struct pollfd *pfd = 0;
+	long long next = now_ms() + interval * 1000LL, now;
+	int i, n, npfd = 0;
+
+	for (;;) {
+		if (npfd < nwatches)
+			pfd = xrealloc(pfd, (npfd = nwatches) * sizeof *pfd);
+		for (i = n = 0; i < nwatches; i++) {
+			if (!watches[i].func) continue;
+			pfd[n].fd = i;
+			pfd[n].events = POLLIN;
+			pfd[n++].revents = 0;
+		}
+		now = now_ms();
+		if (poll(pfd, n, next > now ? next - now : 0) == -1 &&
+		    errno != EINTR)
+			err(EXIT_FAILURE, "poll");
+		for (i = 0; i < n; i++)
+			if (pfd[i].revents)
+				dispatch(pfd[i].fd);
+		if ((now = now_ms()) >= next && tick_func) {
+			tick_func((now - next) / (interval * 1000LL) + 1);
+			next += ((now - next) / (interval * 1000LL) + 1) *
+				interval * 1000LL;
+		}
+	}
+}
+
+#endif /* USE_EPOLL */
+
+/*
+ * Call func every sec seconds with the number of ticks that passed.
+ * Has to be called before anything else here.
+ */
+void loop_init(int sec, void (*func)(unsigned long long n))
+{
+	interval = sec;
+	tick_func = func;
+	sigemptyset(&sig_mask);
+}
@@ -59,9 +59,11 @@ static struct item_bind_t item_bind[] = {
 	{ 1, { DUMMY_HEAD , " Search", "/ ", m_search } } ,
 	{ 1, { DUMMY_HEAD , " All processes", "t ", m_process } } ,
 	{ 1, { DUMMY_HEAD , " Users", "Ent ", m_switch } } ,
+	{ 1, { DUMMY_HEAD , " Login history", "h ", m_history } } ,
 	{ 1, { DUMMY_HEAD , " User proc", "Ent ", m_switch } } ,
 	{ 1, { DUMMY_HEAD , " Details", "d ", m_details } } ,
 	{ 1, { DUMMY_HEAD , " Sysinfo", "s ", m_sysinfo } } ,
+	{ 2, { DUMMY_HEAD , " Filter", "f ", m_filter } } ,
 	{ 2, { DUMMY_HEAD , " Toggle owner", "o ", m_owner } } ,
 	{ 2, { DUMMY_HEAD , " Toggle long", "c ", m_long } } ,
 	{ 2, { DUMMY_HEAD , " Signal list", "l ", m_siglist } } ,
@@ -110,11 +112,9 @@ static void add_item(char *title, struct item_t *i)
 	static unsigned short longest;
 	int len = strlen(i->name);// + strlen(i->descr) + 1;
 	if(!(t = find_submenu(title))) {
-	// dolog("%s: cannot find title %s\n", __FUNCTION__, title);
 		return;
 	}
 	if(len > longest) longest = len;
-	// dolog("%s: %d %d %d\n", __FUNCTION__, longest, strlen(i->descr), t->cols);	
 	if(longest + strlen(i->descr) + 3 > t->cols) 
 		t->cols = 3 + longest + strlen(i->descr);
 	if (t->rows == 0) t->rows = 3; /* make space for a border line */
@@ -288,7 +288,6 @@ bool menu_keys(int key)
 		return KEY_HANDLED;
 	}
 	if(!menu.wd) return KEY_SKIPPED;
-	dolog("%s: submenu_wd %p\n", __FUNCTION__, submenu_wd);	
 	switch(key) {
 	case KEY_ESC:
 		menu_destroy();
@@ -303,7 +302,6 @@ bool menu_keys(int key)
 		if(!submenu_show()) return KEY_HANDLED; 
 		if(change_item(cur_item->l_submenu.prev))
 			highlight_item(cur_submenu, 1);
-		dolog("%s: cur item %s\n", __FUNCTION__, cur_item->name);
 		break;	
 	case KEY_UP:
 		if(!submenu_show()) return KEY_HANDLED; 
@@ -320,10 +318,10 @@ bool menu_keys(int key)
 		menu_destroy();
 		break;
 	default: 
-		dolog("%s: [%d] skipped\n", __FUNCTION__, key);
+		trace_event(TR_MENU_KEY, key, 0, 0);
 		return KEY_HANDLED;
 	}
-	dolog("%s: [%d] accepted\n", __FUNCTION__, key);
+	trace_event(TR_MENU_KEY, key, 1, 0);
 	return KEY_HANDLED;
 }
 
@@ -13,7 +13,7 @@ static char *prev_search;
 
 void  m_exit(void)
 {
-	dolog("%s: entering\n", __FUNCTION__);
+	trace_event(TR_EXIT, 0, 0, 0);
 	exit (EXIT_SUCCESS);
 }	
 
@@ -70,6 +70,11 @@ void m_switch(void)
 	current->keys(KEY_ENTER);
 }
 
+void m_history(void)
+{
+	current->keys('h');
+}
+
 void m_idle(void)
 {
 	current->keys('i');
@@ -105,7 +110,7 @@ static void __load_plugin(char *s)
 
 void m_load_plugin(void)
 {
-	input_box(" Load plugin ", "Path ", 0, __load_plugin);
+	input_box(" Load plugin ", "Path ", 0, __load_plugin, 0);
 }
 
 static void search(char *s)
@@ -121,5 +126,21 @@ void set_search(char *s)
 
 void m_search(void) 
 {
-	input_box(" Search ", "Pattern ", prev_search, search);
+	input_box(" Search ", "Pattern ", prev_search, search, search_typed);
+}
+
+static void filtered(char *s)
+{
+	static char err[64];
+
+	if (!filter_set(s, err, sizeof err)) {
+		info_box(" Filter error ", err);
+		return;
+	}
+	tree_filter();
+}
+
+void m_filter(void)
+{
+	input_box(" Filter ", "Show ", filter_text(), filtered, 0);
 }
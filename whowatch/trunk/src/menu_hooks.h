@@ -8,8 +8,10 @@ void m_long(void);
 void m_about(void);
 void m_load_plugin(void);
 void m_search(void);
+void m_filter(void);
 void help(void);
 void m_switch(void);
+void m_history(void);
 void m_idle(void);
 void m_kill(void);
 void m_hup(void);
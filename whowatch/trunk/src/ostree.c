@@ -0,0 +1,157 @@
+#include "config.h"
+
+#include <stddef.h>
+
+#include "ostree.h"
+
+#define size_of(n)	((n) ? (n)->size : 0)
+
+static unsigned int os_random(void)
+{
+	static unsigned int x = 2463534242u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+static inline void fix_size(struct os_node *n)
+{
+	n->size = size_of(n->left) + size_of(n->right) + 1;
+}
+
+static inline void replace_child(struct os_tree *t, struct os_node *p,
+				 struct os_node *old, struct os_node *new)
+{
+	if (!p) t->root = new;
+	else if (p->left == old) p->left = new;
+	else p->right = new;
+}
+
+/* lift n above its parent */
+static void rotate_up(struct os_tree *t, struct os_node *n)
+{
+	struct os_node *p = n->parent, *b;
+
+	replace_child(t, p->parent, p, n);
+	n->parent = p->parent;
+	if (p->left == n) {
+		b = n->right;
+		p->left = b;
+		n->right = p;
+	} else {
+		b = n->left;
+		p->right = b;
+		n->left = p;
+	}
+	if (b) b->parent = p;
+	p->parent = n;
+	fix_size(p);
+	fix_size(n);
+}
+
+/*
+ * Insert n so that it becomes the node at position pos
+ * (0 is the first, os_count() appends).
+ */
+void os_insert(struct os_tree *t, struct os_node *n, unsigned int pos)
+{
+	struct os_node *p = 0, **link = &t->root;
+	unsigned int l;
+
+	while (*link) {
+		p = *link;
+		p->size++;
+		l = size_of(p->left);
+		if (pos <= l) {
+			link = &p->left;
+		} else {
+			pos -= l + 1;
+			link = &p->right;
+		}
+	}
+	n->left = n->right = 0;
+	n->parent = p;
+	n->size = 1;
+	n->prio = os_random();
+	*link = n;
+	while (n->parent && n->prio < n->parent->prio)
+		rotate_up(t, n);
+}
+
+void os_delete(struct os_tree *t, struct os_node *n)
+{
+	struct os_node *c, *p;
+
+	/* rotate n down until it has at most one child */
+	while (n->left && n->right) {
+		c = n->left->prio < n->right->prio ? n->left : n->right;
+		rotate_up(t, c);
+	}
+	c = n->left ? n->left : n->right;
+	p = n->parent;
+	replace_child(t, p, n, c);
+	if (c) c->parent = p;
+	for (; p; p = p->parent)
+		p->size--;
+}
+
+unsigned int os_rank(struct os_node *n)
+{
+	unsigned int r = size_of(n->left);
+
+	for (; n->parent; n = n->parent)
+		if (n->parent->right == n)
+			r += size_of(n->parent->left) + 1;
+	return r;
+}
+
+struct os_node *os_select(struct os_tree *t, unsigned int pos)
+{
+	struct os_node *n = t->root;
+	unsigned int l;
+
+	while (n) {
+		l = size_of(n->left);
+		if (pos == l) break;
+		if (pos < l) {
+			n = n->left;
+		} else {
+			pos -= l + 1;
+			n = n->right;
+		}
+	}
+	return n;
+}
+
+struct os_node *os_first(struct os_tree *t)
+{
+	struct os_node *n = t->root;
+
+	if (n)
+		while (n->left) n = n->left;
+	return n;
+}
+
+struct os_node *os_next(struct os_node *n)
+{
+	if (n->right) {
+		for (n = n->right; n->left; n = n->left) ;
+		return n;
+	}
+	while (n->parent && n->parent->right == n)
+		n = n->parent;
+	return n->parent;
+}
+
+struct os_node *os_prev(struct os_node *n)
+{
+	if (n->left) {
+		for (n = n->left; n->right; n = n->right) ;
+		return n;
+	}
+	while (n->parent && n->parent->left == n)
+		n = n->parent;
+	return n->parent;
+}
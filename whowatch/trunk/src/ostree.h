@@ -0,0 +1,26 @@
+/*
+ * Order statistics tree: a treap keyed only by position, every node
+ * knows the size of its subtree. Nodes are embedded in the objects
+ * they index. Insertion at a position, removal, the position of
+ * a node and the node at a position are O(log n).
+ */
+
+struct os_node {
+	struct os_node *left, *right, *parent;
+	unsigned int size;		/* nodes in this subtree	*/
+	unsigned int prio;		/* heap order, smaller on top	*/
+};
+
+struct os_tree {
+	struct os_node *root;
+};
+
+#define os_count(t)	((t)->root ? (t)->root->size : 0)
+
+void os_insert(struct os_tree *t, struct os_node *n, unsigned int pos);
+void os_delete(struct os_tree *t, struct os_node *n);
+unsigned int os_rank(struct os_node *n);
+struct os_node *os_select(struct os_tree *t, unsigned int pos);
+struct os_node *os_first(struct os_tree *t);
+struct os_node *os_next(struct os_node *n);
+struct os_node *os_prev(struct os_node *n);
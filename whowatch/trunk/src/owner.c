@@ -1,23 +1,44 @@
 /*
  * Functions needed for printing process owner in the tree.
+ * Names are kept, the tree and search ask for the same few
+ * owners over and over and getpwuid() may read /etc/passwd or
+ * ask nss each time.
  */
 #include "config.h"
 #include <stdio.h>
 #include <pwd.h>
 #include <sys/types.h>
 
-#define NAME_SIZE	8
+#define NAME_SIZE	32
+#define OWNERS		256		/* a power of two		*/
+
+struct owner
+{
+	int uid;
+	char name[NAME_SIZE + 1];
+};
+
+static struct owner owners[OWNERS];
+static int nowners;
 
 char *get_owner_name (int uid)
 {
 	static char name[NAME_SIZE + 1];
 	struct passwd *u;
+	struct owner *o;
+	unsigned int h;
 
-	u = getpwuid (uid);
-	if (u) {
-		return u->pw_name;
-	}
+	for (h = uid & (OWNERS - 1); owners[h].name[0]; h = (h + 1) & (OWNERS - 1))
+		if (owners[h].uid == uid) return owners[h].name;
 
-	snprintf (name, NAME_SIZE + 1, "%d", uid);
-	return name;
+	u = getpwuid (uid);
+	if (u) snprintf (name, sizeof name, "%s", u->pw_name);
+	else snprintf (name, sizeof name, "%d", uid);
+	/* full, the rest are looked up every time */
+	if (nowners == OWNERS / 2) return name;
+	o = &owners[h];
+	o->uid = uid;
+	snprintf (o->name, sizeof o->name, "%s", name);
+	nowners++;
+	return o->name;
 }
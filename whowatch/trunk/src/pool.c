@@ -0,0 +1,76 @@
+#include "config.h"
+
+#include <string.h>
+
+#include "whowatch.h"
+#include "pool.h"
+
+struct pool_chunk {
+	struct pool_chunk *next;
+};
+
+/* objects must be able to hold the free list link */
+#define OBJ_ALIGN	(sizeof(void *) > 8 ? sizeof(void *) : 8)
+
+static struct pool *pools;
+
+static inline size_t obj_size(struct pool *p)
+{
+	size_t s = p->size < sizeof(void *) ? sizeof(void *) : p->size;
+	return (s + OBJ_ALIGN - 1) & ~(OBJ_ALIGN - 1);
+}
+
+static void new_chunk(struct pool *p)
+{
+	struct pool_chunk *c = xmalloc(POOL_CHUNK);
+
+	if (!p->chunks) {
+		p->next = pools;
+		pools = p;
+	}
+	c->next = p->chunks;
+	p->chunks = c;
+	p->nchunks++;
+	p->bump = (char *) c + OBJ_ALIGN;
+	p->end = (char *) c + POOL_CHUNK;
+}
+
+/*
+ * Return a zeroed object. Recently freed objects are reused first,
+ * they are more likely to be in the cache.
+ */
+void *pool_alloc(struct pool *p)
+{
+	size_t size = obj_size(p);
+	void *obj;
+
+	if (p->free) {
+		obj = p->free;
+		p->free = *(void **) obj;
+		p->nfree--;
+	} else {
+		if (!p->chunks || p->bump + size > p->end)
+			new_chunk(p);
+		obj = p->bump;
+		p->bump += size;
+	}
+	p->live++;
+	return memset(obj, 0, size);
+}
+
+void pool_free(struct pool *p, void *obj)
+{
+	if (!obj) return;
+	*(void **) obj = p->free;
+	p->free = obj;
+	p->nfree++;
+	p->live--;
+}
+
+void pool_for_each(void (*func)(struct pool *p, void *data), void *data)
+{
+	struct pool *p;
+
+	for (p = pools; p; p = p->next)
+		func(p, data);
+}
@@ -0,0 +1,30 @@
+/*
+ * Pools of fixed size objects. Memory is taken from the system in
+ * large chunks and freed objects are kept on a list for reuse, so
+ * processes that come and go don't fragment the heap. Chunks are
+ * never given back.
+ */
+
+#include <stddef.h>
+
+#define POOL_CHUNK	(64 * 1024)
+
+struct pool_chunk;
+
+struct pool {
+	const char *name;
+	size_t size;			/* object size			*/
+	struct pool *next;		/* list of used pools		*/
+	struct pool_chunk *chunks;
+	char *bump, *end;		/* unused part of the last chunk */
+	void *free;			/* freed objects		*/
+	unsigned long live;		/* objects handed out		*/
+	unsigned long nfree;		/* objects on the free list	*/
+	unsigned long nchunks;
+};
+
+#define POOL_INIT(name, type)	{ name, sizeof(type) }
+
+void *pool_alloc(struct pool *p);
+void pool_free(struct pool *p, void *obj);
+void pool_for_each(void (*func)(struct pool *p, void *data), void *data);
@@ -5,19 +5,44 @@
 
 #include "whowatch.h"
 #include "proctree.h"
+#include "pool.h"
 
 static int allocated;
 
-static struct process *begin;
+/*
+ * Lines of the process window in tree order. The line number of
+ * a process is its rank, so nothing is renumbered when lines come
+ * and go.
+ */
+static struct os_tree lines;
+static struct process *dead;		/* marked by mark_del()		*/
+static struct pool process_pool = POOL_INIT("process", struct process);
 static pid_t tree_root = 1;
 static bool show_owner;
 
+#define node_proc(n)	((struct process *) (n))
+
+static inline int proc_line(struct process *p)
+{
+	return os_rank(&p->node);
+}
+
+static inline struct process *proc_at(int line)
+{
+	if (line < 0) return 0;
+	return node_proc(os_select(&lines, line));
+}
+
+static inline struct process *proc_next(struct process *p)
+{
+	return node_proc(os_next(&p->node));
+}
+
 static void proc_del(struct process *p)
 {						
-	*p->prev=p->next;				
-	if (p->next) p->next->prev = p->prev;
+	os_delete(&lines, &p->node);
 	if (p->proc) p->proc->priv = 0;	
-	free(p);
+	pool_free(&process_pool, p);
 	proc_win.d_lines--;					
 	allocated--;					
 }
@@ -32,20 +57,16 @@ static void mark_del(void *vp)
 
 	p->proc->priv = 0;	
 	p->proc = 0;
-}
-
-static inline bool is_marked (struct process *p)
-{
-  return (p->proc == NULL);
+	p->dead = dead;
+	dead = p;
 }
 
 static void clear_list()
 {
-	struct process *p, *q;
-	for(p = begin; p; p = q){
-		q = p->next;
+	struct process *p;
+	while ((p = node_proc(os_first(&lines))))
 		proc_del(p);
-	}
+	dead = 0;
 }
 
 /*
@@ -59,59 +80,138 @@ static void check_line(int line)
 		proc_win.offset++;
 }
 
-static void synchronize(void)
+static void add_line(struct proc_t *p, int l)
+{
+	struct process *z = pool_alloc(&process_pool);
+	allocated++;
+	proc_win.d_lines++;
+	check_line(l);
+	os_insert(&lines, &z->node, l);
+	p->priv = z;
+	z->proc = p;
+}
+
+/*
+ * Walk the whole tree and add lines for processes that don't have
+ * them. Used when the window is filled for the first time.
+ */
+static void synchronize_all(void)
 {
 	int l = 0;
 	struct proc_t *p = tree_start(tree_root, tree_root);
-	struct process **current = &begin, *z;
+	struct process *cur = node_proc(os_first(&lines));
 	while (p) {
-	  if ((*current != NULL) && (p->priv != NULL)) {
-			(*current)->line = l++;
-			(*current)->proc->priv = *current;
+		if (cur && p->priv) {
+			l++;
 			p = tree_next();
-			current = &((*current)->next);
+			cur = proc_next(cur);
 			continue;
 		}
-		z = xmalloc(sizeof *z);
-		allocated++;
-		proc_win.d_lines++;
-		memset(z, 0, sizeof *z);
-		check_line(l);
-		z->line = l++;
-		p->priv = z;
-		z->proc = p;
-		if (*current){
-			z->next = *current;
-			(*current)->prev = &z->next;
-		}
-		*current = z;
-		z->prev = current;
-		current = &(z->next);
+		add_line(p, l++);
 		p = tree_next();
 	}
+	tree_pending_clear();
+}
+
+static void delete_tree_lines();
+
+/*
+ * Give lines to p and its descendants, right below the line of the
+ * process that precedes p in the tree.
+ */
+static void insert_subtree(struct proc_t *p)
+{
+	struct proc_t *q = tree_prev(p);
+	struct process *last;
+	int l;
+
+	if (!q->priv) {
+		insert_subtree(q);
+		if (p->priv) return;	/* q was the parent */
+	}
+	last = q->priv;
+	for (q = tree_start(p->pid, p->pid); q; q = tree_next()) {
+		if (q->priv) {
+			/* shouldn't happen, but keep lines in tree order */
+			mark_del(q->priv);
+			delete_tree_lines();
+		}
+		l = proc_line(last) + 1;
+		add_line(q, l);
+		last = q->priv;
+	}
+}
+
+/*
+ * Add lines for processes that are new or were moved in the tree
+ * since the last call. Lines of other processes are not visited.
+ */
+static void synchronize(void)
+{
+	struct proc_t *p = tree_start(tree_root, tree_root);
 
+	if (!p || !p->priv) {
+		synchronize_all();
+		return;
+	}
+	while ((p = tree_pending()))
+		if (!p->priv && tree_within(tree_root, p))
+			insert_subtree(p);
 }
 
+/*
+ * Remove lines of processes marked by mark_del(). Only the marked
+ * ones are visited.
+ */
 static void delete_tree_lines()
 {
-	struct process *u, *p;
-	p = begin;
-	while(p){
-		if (!is_marked(p)){
-			p = p->next;
-			continue;
+	struct process *p;
+	while ((p = dead)) {
+		dead = p->dead;
+		delete_line(&proc_win, proc_line(p));
+		proc_del(p);
+	}
+}
+
+/*
+ * With a filter only the processes that match and their ancestors
+ * have lines. Every process is tested, then the ancestors of those
+ * that matched are marked up to the first one already marked, so
+ * this pass is linear. Lines of processes no longer shown go and
+ * the tree is walked again without going into subtrees that have
+ * nothing to show.
+ */
+static void filter_lines(void)
+{
+	static unsigned int pass;
+	struct proc_t *p, *q;
+	struct process *z, *next;
+	int l = 0;
+
+	pass++;
+	for (p = tree_start(tree_root, tree_root); p; p = tree_next()) {
+		p->matched = filter_match(&p->info);
+		if (!p->matched) continue;
+		for (q = p; q && q->shown != pass; q = q->parent) {
+			q->shown = pass;
+			if (q->pid == tree_root) break;
 		}
-//dolog(__FUNCTION__": line %d\n", p->line);
-		delete_line(&proc_win, p->line);
-		u = p;
-		while(u) {
-			u->line--;
-			u = u->next;
+	}
+	for (z = node_proc(os_first(&lines)); z; z = next) {
+		next = proc_next(z);
+		if (z->proc && z->proc->shown != pass) mark_del(z);
+	}
+	delete_tree_lines();
+	for (p = tree_start(tree_root, tree_root); p; ) {
+		if (p->shown != pass) {
+			p = tree_skip();
+			continue;
 		}
-		u = p->next;
-		proc_del(p);
-		p = u;
+		if (!p->priv) add_line(p, l);
+		l++;
+		p = tree_next();
 	}
+	tree_pending_clear();
 }
 
 static char get_state_color(char state)
@@ -124,20 +224,25 @@ static char get_state_color(char state)
 
 static char *prepare_line(struct process *p)
 {
-	char *tree;
+	char tree[TREE_STRING_SZ];
+	struct pinfo *i;
+	char state, cmd;
 	if (!p) return 0;
-	tree = tree_string(tree_root, p->proc);
-	get_state(p);
+	tree_string(tree_root, p->proc, tree);
+	i = &p->proc->info;
+	state = (i->state == 'S') ? ' ' : i->state;
+	/* ancestors shown only for what the filter matched below them */
+	cmd = filter_on() && !p->proc->matched ? '\x1' : '\x3';
 	if (show_owner) {
-		snprintf(line_buf, buf_size,"\x3%5d %c%c \x3%-8s \x2%s \x3%s", 
-			p->proc->pid, get_state_color(p->state), 
-			p->state, get_owner_name(p->uid), tree, 
-			get_cmdline(p->proc->pid));
+		snprintf(line_buf, buf_size,"\x3%5d %c%c \x3%-8s \x2%s %c%s", 
+			p->proc->pid, get_state_color(state), 
+			state, get_owner_name(i->euid), tree, cmd,
+			tree_cmdline(&p->proc->info));
 	}
 	else {
-		snprintf(line_buf, buf_size,"\x3%5d %c%c \x2%s \x3%s", 
-			p->proc->pid, get_state_color(p->state), 
-			p->state, tree, get_cmdline(p->proc->pid));
+		snprintf(line_buf, buf_size,"\x3%5d %c%c \x2%s %c%s", 
+			p->proc->pid, get_state_color(state), 
+			state, tree, cmd, tree_cmdline(&p->proc->info));
 	}	
 	return line_buf;
 }
@@ -145,22 +250,16 @@ static char *prepare_line(struct process *p)
 	
 static char *proc_give_line(int line)
 {
-	struct process *p;
-	for (p = begin; p ; p = p->next){
-		if (p->line == line){
-			if (!p->proc) return "\x1 deleted";
-			return prepare_line(p);
-		}
-	}
-	return NULL;
+	struct process *p = proc_at(line);
+	if (!p) return NULL;
+	if (!p->proc) return "\x1 deleted";
+	return prepare_line(p);
 }
 
 static pid_t pid_from_tree(int line)
 {
-	struct process *p;
-	for (p = begin; p; p = p->next){
-		if (p->line == line) return p->proc->pid;
-	}
+	struct process *p = proc_at(line);
+	if (p && p->proc) return p->proc->pid;
 	return 0;
 }	
 
@@ -170,33 +269,35 @@ pid_t cursor_pid(void)
 }
 
 /*
- * Find process by its command line. 
- * Processes that have line number (data line, not screen)
- * lower than second argument are skipped. Called by do_search.
+ * Does the process on the line match the search, by pid, owner
+ * or command line.
  */
-unsigned int getprocbyname(int l)
+static bool proc_match(int line)
 {
-	struct process *p;
-	char *tmp, buf[8];
-	for(p = begin; p ; p = p->next){
-		if(!p->proc) continue;
-		if(p->line <= l) continue;
-		/* try the pid first */
-		snprintf(buf, sizeof buf, "%d", p->proc->pid);
-		if(reg_match(buf)) return p->line;
-		/* next process owner */
-		if(show_owner && reg_match(get_owner_name(p->uid))) 
-			return p->line;
-		tmp = get_cmdline(p->proc->pid);
-		if(reg_match(tmp)) return p->line;
-	}
-	return -1;
+	struct process *p = proc_at(line);
+	char buf[12], *tmp = buf + sizeof buf;
+	int pid;
+
+	if(!p || !p->proc) return false;
+	/* try the pid first, snprintf() would cost more than the match */
+	pid = p->proc->pid;
+	*--tmp = 0;
+	do *--tmp = '0' + pid % 10;
+	while((pid /= 10) > 0);
+	if(reg_match(tmp)) return true;
+	/* next process owner */
+	if(show_owner && reg_match(get_owner_name(p->proc->info.euid)))
+		return true;
+	return reg_match(tree_cmdline(&p->proc->info));
 }
 
 void tree_title(struct user_t *u)
 {
 	char buf[64];
-	if(!u) snprintf(buf, sizeof buf, "%d processes", proc_win.d_lines);
+	if(!u && filter_on())
+		snprintf(buf, sizeof buf, "%d processes, filter %s",
+			 proc_win.d_lines, filter_text());
+	else if(!u) snprintf(buf, sizeof buf, "%d processes", proc_win.d_lines);
 	else snprintf(buf, sizeof buf, "%-14.14s %-9.9s %-6.6s %s",
                 	u->parent, u->name, u->tty, u->host);
 	wattrset(info_win.wd, A_BOLD);
@@ -215,35 +316,95 @@ static void clear_tree_title(void)
 static void draw_tree(void)
 {
 	struct process *p;
-	if(!begin) {
+	int l;
+	if(!os_count(&lines)) {
 		WINDOW *w = proc_win.wd;
 		wmove(w, 0, 0);
 		wclrtoeol(w);
 		wattrset(w, A_NORMAL);
-		waddstr(w, "User logged out");
+		waddstr(w, filter_on() ? "No process matches the filter" :
+			"User logged out");
 		current->d_lines = 1;		
 		return;
 	}
-	for(p = begin; p ;p = p->next) {
+	l = proc_win.offset;
+	for(p = proc_at(l); p && !below(l, &proc_win); p = proc_next(p), l++) {
 		if(!p->proc) continue;
-		if(above(p->line, &proc_win)) continue;
-		if(below(p->line, &proc_win)) break;
-		print_line(&proc_win,prepare_line(p), p->line, 0);
+		print_line(&proc_win,prepare_line(p), l, 0);
 	}
 }
 
-static void tree_periodic(void)
+/*
+ * Between full scans only processes on the screen are read again.
+ */
+static void refresh_visible(void)
 {
-	update_tree(mark_del);
+	struct process *p;
+	int l = proc_win.offset;
+	for(p = proc_at(l); p && !below(l, &proc_win); p = proc_next(p), l++)
+		if(p->proc) tree_refresh(p->proc);
+}
+
+/*
+ * Lines of processes that went away go, then the new ones come.
+ */
+static void update_lines(void)
+{
+	prof_begin(PROF_DELETE);
 	delete_tree_lines();
-	synchronize();
+	prof_end(PROF_DELETE);
+	prof_begin(PROF_SYNC);
+	if (filter_on()) filter_lines();
+	else synchronize();
+	prof_end(PROF_SYNC);
+	search_forget();
+}
+
+static void tree_periodic(void)
+{
+	bool full = tree_stale();
+
+	if (full) update_tree(mark_del);
+	else tree_reap(mark_del);
+	update_lines();
+	if (!full) refresh_visible();
+	prof_begin(PROF_DRAW);
 	draw_tree();
+	prof_end(PROF_DRAW);
+}
+
+/*
+ * Bring the tree up to date when the process window, which would
+ * do it itself, is not shown. Used by the recorder.
+ */
+void tree_sync(void)
+{
+	if (current != &proc_win) {
+		if (tree_stale()) update_tree(mark_del);
+		else tree_reap(mark_del);
+	}
+}
+
+/*
+ * Called when process events are pending. Returns true if the
+ * process window has been redrawn.
+ */
+bool tree_events_ready(void)
+{
+	if (!tree_events(mark_del) || current != &proc_win)
+		return false;
+	update_lines();
+	prof_begin(PROF_DRAW);
+	draw_tree();
+	prof_end(PROF_DRAW);
+	return true;
 }
 
 void show_tree(pid_t pid)
 {
 //        print_help(state);
 	proc_win.offset = proc_win.cursor = 0;
+	clear_list();
 	tree_root = INIT_PID;
 	if(pid > 0) tree_root = pid; 
         tree_periodic();
@@ -251,6 +412,17 @@ void show_tree(pid_t pid)
 //	tree_title(0); // change it!
 }
 
+/*
+ * The filter has changed, lines are given again.
+ */
+void tree_filter(void)
+{
+	if (current != &proc_win) return;
+	werase(main_win);
+	show_tree(tree_root);
+	if (tree_root == INIT_PID) tree_title(0);
+}
+
 void do_signal(int sig, int pid)
 {
 	send_signal(sig, pid);
@@ -269,7 +441,6 @@ static bool signal_keys (int key)
 	case KEY_CTRL_T: signal = 15; break;
 	}
 	if (signal != 0) { 
-	  dolog("%s: %x %x\n", __FUNCTION__, key, 'H');	
 	  do_signal(signal, cursor_pid());
 	  return KEY_HANDLED;
 	}
@@ -299,6 +470,13 @@ static bool proc_key (int key)
                 show_tree(INIT_PID);
 		tree_title(0);
                 break;
+	case 'f':
+		m_filter();
+		break;
+	case 'F':
+		filter_set("", 0, 0);
+		tree_filter();
+		break;
         default: return KEY_SKIPPED;
         }
         return KEY_HANDLED;
@@ -311,4 +489,5 @@ void procwin_init(void)
 	proc_win.keys = proc_key;
 	proc_win.periodic = tree_periodic;
 	proc_win.redraw = draw_tree;
+	proc_win.match = proc_match;
 }
@@ -6,14 +6,15 @@
 #include "config.h"
 
 #include <unistd.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "whowatch.h"
 #include "machine.h"
 #include "proctree.h"
-
-#define HASHSIZE 128
+#include "pool.h"
 
 #define list_add(l,p,f) ({			\
 	(p)->f.nx = (l);			\
@@ -34,42 +35,111 @@
 #define proc_zero (proc_special[0])
 #define proc_init (proc_special[1])
 static struct proc_t proc_special[2] = {{0},{1}};
-static struct proc_t *hash_table[HASHSIZE];
 static struct proc_t *main_list = 0;
+static struct proc_t *pending = 0;	/* see tree_pending()		*/
 static int num_proc = 1;
+static struct pool proc_pool = POOL_INIT("proc_t", struct proc_t);
+
+/*
+ * Index of processes by pid: open addressing with linear probing.
+ * Slots keep the pid next to the pointer so a lookup touches only
+ * the table. It is kept at most half full and doubled when needed;
+ * deletion moves the following entries back, there are no tombstones.
+ */
+#define PID_INDEX_MIN	256
+
+struct pid_slot {
+	int pid;			/* 0 if the slot is empty	*/
+	struct proc_t *p;
+};
+
+static struct pid_slot *pid_index;
+static unsigned int index_mask;		/* size - 1, size is power of 2	*/
+static unsigned int index_shift;	/* 32 - log2(size)		*/
 
-static inline int hash_fun(int n)
+static inline unsigned int pid_hash(int pid)
 {
-	return n&(HASHSIZE-1);
+	return ((unsigned int) pid * 2654435761u) >> index_shift;
+}
+
+static inline struct pid_slot *pid_slot(int pid)
+{
+	unsigned int i = pid_hash(pid);
+
+	while (pid_index[i].pid && pid_index[i].pid != pid)
+		i = (i + 1) & index_mask;
+	return &pid_index[i];
+}
+
+static void index_resize(unsigned int size)
+{
+	struct pid_slot *old = pid_index;
+	unsigned int i, old_size = pid_index ? index_mask + 1 : 0;
+
+	pid_index = xcalloc(size, sizeof *pid_index);
+	index_mask = size - 1;
+	for (index_shift = 32; size > 1; size >>= 1)
+		index_shift--;
+	for (i = 0; i < old_size; i++)
+		if (old[i].pid)
+			*pid_slot(old[i].pid) = old[i];
+	free(old);
 }
 
 static struct proc_t* find_by_pid(int n)
 {
-	struct proc_t* p;
 	if(n<=1) return &proc_special[n];
+	if(!pid_index) return 0;
+	return pid_slot(n)->p;
+}
 
-	p = hash_table[hash_fun(n)];
-	while(p) {
-		if(p->pid == n) break;
-		p=p->hash.nx;
-	}
-	return p;
+static inline void set_pending(struct proc_t *p)
+{
+	if (!is_on_list(p,pend)) list_add(pending,p,pend);
+}
+
+static inline void unset_pending(struct proc_t *p)
+{
+	if (!is_on_list(p,pend)) return;
+	list_del(p,pend);
+	p->pend.ppv = 0;
 }
 
 static inline void remove_proc(struct proc_t* p)
 {
-	list_del(p,hash);
+	unsigned int i, j, k;
+
+	unset_pending(p);
+	i = pid_slot(p->pid) - pid_index;
+	for (j = (i + 1) & index_mask; pid_index[j].pid;
+	     j = (j + 1) & index_mask) {
+		k = pid_hash(pid_index[j].pid);
+		/* entry at j may move to i if its home is not in (i, j] */
+		if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+			pid_index[i] = pid_index[j];
+			i = j;
+		}
+	}
+	pid_index[i].pid = 0;
+	pid_index[i].p = 0;
+	free(p->prefix);
+	pool_free(&proc_pool, p);
 	num_proc--;
 }
 
 static inline struct proc_t* new_proc(int n)
 {
         struct proc_t* p;
+	struct pid_slot *s;
 
-	p = (struct proc_t*) xcalloc (1, sizeof *p);
+	if (!pid_index || 2 * (num_proc + 1) > index_mask + 1)
+		index_resize(pid_index ? 2 * (index_mask + 1) : PID_INDEX_MIN);
+	p = pool_alloc(&proc_pool);
 	p->pid = n;
 
-	list_add(hash_table[hash_fun(n)], p, hash);
+	s = pid_slot(n);
+	s->pid = n;
+	s->p = p;
 	num_proc++;
 
 	return p;
@@ -93,13 +163,81 @@ static struct proc_t *validate_proc(int pid)
 	return p;
 }
 
+/*
+ * Drop cached prefixes of p and its descendants. A node without
+ * one never has descendants with one, so stale subtrees are skipped.
+ */
+static void invalidate(struct proc_t *p)
+{
+	struct proc_t *q;
+
+	if (!p->prefix) return;
+	free(p->prefix);
+	p->prefix = 0;
+	for (q = p->child; q; q = q->broth.nx)
+		invalidate(q);
+}
+
+static inline struct proc_t *prev_brother(struct proc_t *p)
+{
+	if (p->broth.ppv == &p->parent->child) return 0;
+	return (struct proc_t *) ((char *) p->broth.ppv -
+				  offsetof(struct proc_t, broth.nx));
+}
+
+/*
+ * Take p off its brothers list. If it was the last one, the one
+ * before it is the last now and is drawn differently.
+ */
+static inline void unlink_brother(struct proc_t *p)
+{
+	struct proc_t *q;
+
+	if (!p->broth.nx && (q = prev_brother(p)))
+		invalidate(q);
+	list_del(p,broth);
+}
+
 static inline void change_parent(struct proc_t* p,struct proc_t* q)
 {
 	if (is_on_list(p,broth)) {
-		list_del(p,broth);
+		unlink_brother(p);
 	}
+	invalidate(p);
 	list_add(q->child,p,broth);
 	p->parent = q;
+	set_pending(p);
+}
+
+/*
+ * Processes that have exited but may not have been reaped. Exit
+ * events come when a process exits, not when it is reaped, so they
+ * are kept as zombies the way a scan shows them and looked at
+ * again every tick until they are gone.
+ */
+static int *zombies, nzombies, zombies_size;
+
+static void watch_zombie (int pid)
+{
+  int i;
+
+  for (i = 0; i < nzombies; i++)
+    if (zombies[i] == pid) return;
+  if (nzombies == zombies_size) {
+    zombies_size = zombies_size ? 2 * zombies_size : 16;
+    zombies = xrealloc (zombies, zombies_size * sizeof *zombies);
+  }
+  zombies[nzombies++] = pid;
+}
+
+/*
+ * Is q p or one of its descendants?
+ */
+static bool descends (struct proc_t *q, struct proc_t *p)
+{
+  for (; q; q = q->parent)
+    if (q == p) return true;
+  return false;
 }
 
 void update_tree_helper (struct pinfo *ptr, void *data)
@@ -108,45 +246,252 @@ void update_tree_helper (struct pinfo *ptr, void *data)
   struct proc_t *p = validate_proc (ptr->pid);
   struct proc_t *q = validate_proc (ptr->ppid);
 
+  p->info = *ptr;
+  if (ptr->state == 'Z') watch_zombie (ptr->pid);
+  /*
+   * Snapshots from whowatchd or a recording may be made up and a
+   * reused pid may meet a stale node, the tree must stay a tree.
+   */
+  if (p->parent != q && (q == p || (p->child && descends (q, p))))
+    q = &proc_zero;
   if (p->parent != q) {
     if (p->priv) del (p->priv);
     change_parent (p, q);
   }
 }
 
+static void drop_proc (struct proc_t *p, void (*del) (void*))
+{
+  /* before the children move away, so their lines go as well */
+  if(p->priv) del(p->priv);
+  while (p->child) {
+    change_parent(p->child,&proc_init);
+  }
+  if (is_on_list(p,broth)) {
+    unlink_brother(p);
+  }
+  list_del(p,mlist);
+  remove_proc(p);
+}
+
+static bool scanned, events_on, events_lost;
+static unsigned long long last_scan;
+
+/*
+ * Where snapshots come from, /proc unless a recording is replayed.
+ */
+static void (*scan)(void (*func)(struct pinfo *, void *), void *) =
+	for_each_pinfo;
+static char *(*cmdline)(struct pinfo *) = cmdline_lookup;
+
+void tree_source (void (*s)(void (*func)(struct pinfo *, void *), void *),
+		  char *(*c)(struct pinfo *))
+{
+  scan = s;
+  cmdline = c;
+}
+
+/*
+ * Command line of a process in the tree.
+ */
+char *tree_cmdline (struct pinfo *i)
+{
+  return cmdline(i);
+}
+
 void update_tree (void (*del) (void*))
 {
   struct proc_t *p,*q;
   struct proc_t *old_list;
+  prof_begin (PROF_SCAN);
   change_head (main_list, old_list,mlist);
   main_list = 0;
+  nzombies = 0;
 
-  for_each_pinfo (&update_tree_helper, (void*)del);
+  scan (&update_tree_helper, (void*)del);
 
   for (p = old_list; p != NULL; p = q) {
-    while (p->child) {
-      change_parent(p->child,&proc_init);
+    q = p->mlist.nx;
+    drop_proc(p, del);
+  }
+  prof_end (PROF_SCAN);
+  scanned = true;
+  events_lost = false;
+  last_scan = ticks;
+}
+
+/*
+ * With process events from the kernel the tree is kept up to date
+ * between scans of /proc. A full scan is still done every
+ * RESCAN_TICKS to pick up state changes and anything we missed.
+ */
+#define RESCAN_TICKS	10
+
+static void apply_event (int what, int pid, void *data)
+{
+  void (*del) (void*) = (void (*) (void *)) data;
+  struct proc_t *p;
+  struct pinfo info;
+
+  switch (what) {
+  case PEV_EXEC:
+    cmdline_forget(pid);
+    owner_forget(pid);
+    /* fall through */
+  case PEV_FORK:
+    if (!get_pinfo(pid, &info))
+      break;			/* already gone */
+    update_tree_helper(&info, data);
+    break;
+  case PEV_EXIT:
+    if (pid <= 1 || !(p = find_by_pid(pid)))
+      break;
+    /* it stays in the tree until its parent has reaped it */
+    if (get_pinfo(pid, &info) && info.start_time == p->info.start_time) {
+      p->info = info;
+      watch_zombie (pid);
     }
-    if (is_on_list(p,broth)) {
-      list_del(p,broth);
+    else drop_proc(p, del);
+    break;
+  }
+}
+
+/*
+ * Subscribe to process events. Returns the descriptor to wait on
+ * or -1 if they are not available.
+ */
+int tree_events_init (void)
+{
+  int fd = proc_events_open();
+
+  events_on = fd != -1;
+  return fd;
+}
+
+/*
+ * Apply pending process events. Returns true if there were any.
+ */
+bool tree_events (void (*del) (void*))
+{
+  int n = proc_events_read(apply_event, (void*)del);
+
+  if (n == -1) events_lost = true;
+  return n != 0;
+}
+
+/*
+ * Drop the exited processes that have been reaped since the last
+ * call. Returns true if there were any.
+ */
+bool tree_reap (void (*del) (void*))
+{
+  struct proc_t *p;
+  struct pinfo info;
+  bool gone = false;
+  int i = 0;
+
+  while (i < nzombies) {
+    p = find_by_pid (zombies[i]);
+    if (p && get_pinfo (p->pid, &info) &&
+	info.start_time == p->info.start_time) {
+      p->info = info;
+      i++;
+      continue;
     }
-    q = p->mlist.nx;
-    if(p->priv) del(p->priv);
-    remove_proc(p);
+    if (p) drop_proc (p, del);
+    zombies[i] = zombies[--nzombies];
+    gone = true;
   }
+  return gone;
+}
+
+/*
+ * Should the next update scan whole /proc?
+ */
+bool tree_stale (void)
+{
+  return !events_on || !scanned || events_lost ||
+    ticks - last_scan >= RESCAN_TICKS;
+}
+
+/*
+ * Read the snapshot of one process again, used between full scans
+ * for processes that are on the screen.
+ */
+void tree_refresh (struct proc_t *p)
+{
+  struct pinfo info;
+
+  if (get_pinfo(p->pid, &info) && info.start_time == p->info.start_time)
+    p->info = info;
+}
+
+/*
+ * Processes that got a new parent since the last call, new ones
+ * included. Their lines (and lines of their descendants) have to be
+ * inserted; everything else stays where it was.
+ */
+struct proc_t *tree_pending(void)
+{
+	struct proc_t *p = pending;
+	if (p) unset_pending(p);
+	return p;
+}
+
+void tree_pending_clear(void)
+{
+	while (tree_pending()) ;
+}
+
+/*
+ * Process that precedes p in the order of tree_next(): the last
+ * descendant of its previous brother or its parent.
+ */
+struct proc_t *tree_prev(struct proc_t *p)
+{
+	struct proc_t *q = prev_brother(p);
+
+	if (!q) return p->parent;
+	while (q->child)
+		for (q = q->child; q->broth.nx; q = q->broth.nx) ;
+	return q;
+}
+
+bool tree_within(int root, struct proc_t *p)
+{
+	for (; p; p = p->parent)
+		if (p->pid == root) return true;
+	return false;
+}
+
+/*
+ * Snapshot of the process taken by the last update_tree().
+ */
+struct pinfo *tree_pinfo(int pid)
+{
+	struct proc_t *p = find_by_pid(pid);
+	if (!p || !p->info.pid) return 0;
+	return &p->info;
 }
 
 /* ---------------------- */
 
 static struct proc_t *proc, *root;
+static int level;			/* of proc below root		*/
 
 struct proc_t* tree_start(int root_pid, int start_pid)
 {
+	struct proc_t *q;
+
 	root = find_by_pid(root_pid);
 	if (!root) return 0;
 	proc = find_by_pid(start_pid);
-	if(start_pid)
+	if(start_pid) {
+		for (level = 0, q = proc; q && q != root; q = q->parent)
+			level++;
 		return proc;
+	}
+	level = 0;
 	return tree_next();	/* skip zero proc - it doesn't really exist */
 }
 
@@ -154,58 +499,96 @@ struct proc_t* tree_next()
 {
 	if (proc->child) {
 		proc = proc->child;
+		level++;
+		return proc;
 	}
-	else {
-		for(;; proc = proc->parent) {
-			if(proc == root)
-				proc = 0;
-			else if(proc->broth.nx)
-				proc = proc->broth.nx;
-			else
-				continue;
-			break;
-		}
+	return tree_skip();
+}
+
+/*
+ * Like tree_next(), but the descendants of the current process
+ * are left out.
+ */
+struct proc_t* tree_skip()
+{
+	for(;; proc = proc->parent, level--) {
+		if(proc == root)
+			proc = 0;
+		else if(proc->broth.nx)
+			proc = proc->broth.nx;
+		else
+			continue;
+		break;
 	}
 	return proc;
 }
 
-static char buf[TREE_STRING_SZ];
-
-char* tree_string(int root, struct proc_t *p)
+/*
+ * How far below the root the process tree_next() or tree_skip()
+ * returned last is, its children are 1.
+ */
+int tree_depth()
 {
-	struct proc_t *q;
-	char *s;
-	int i, d;
-
-	i = 0;
-	for(q=p; q->pid!=root; q=q->parent)
-		i++;
-
-	if(root == 0)
-		i--;	/* forest of all processes case */
-	d = i;
-
-	while(i > TREE_DEPTH)
-		p=p->parent, i--;
-
-	s = buf + 2*i;
-	s[1] = 0;
-	s[0] = '.';
+	return level;
+}
 
-	if(d <= TREE_DEPTH) {
-		s[0] = '-';
-		if(i > 0 && !p->broth.nx) {
-			*--s = '`';
-			goto loop;
-		}
+/*
+ * Every process caches the part of the drawing that its children
+ * share: one "  " or " |" for each of its ancestors and itself
+ * (counted from the zero process), depending on whether there are
+ * more brothers below. It is rebuilt only after the ancestry or the
+ * position among brothers changed.
+ */
+static void make_prefix(struct proc_t *p)
+{
+	struct proc_t *q = p->parent;
+	int n;
+
+	if (p->prefix) return;
+	if (!q) {			/* the zero process */
+		p->depth = 0;
+		p->prefix = xstrdup("");
+		return;
 	}
+	make_prefix(q);
+	p->depth = q->depth + 1;
+	n = 2 * q->depth;
+	p->prefix = xmalloc(n + 3);
+	memcpy(p->prefix, q->prefix, n);
+	p->prefix[n] = ' ';
+	p->prefix[n + 1] = p->broth.nx ? '|' : ' ';
+	p->prefix[n + 2] = '\0';
+}
 
-	while(i > 0) {
-		*--s = p->broth.nx ? '|' : ' ';
-loop:
-		*--s = ' ';
-		p=p->parent, i--;
+/*
+ * Put the tree drawing for p into buf (TREE_STRING_SZ bytes) and
+ * return it. Levels above root are cut off, only TREE_DEPTH levels
+ * are drawn and a dot marks deeper processes.
+ */
+char* tree_string(int root, struct proc_t *p, char *buf)
+{
+	struct proc_t *r = find_by_pid(root);
+	char *s = buf;
+	int skip, i;
+
+	if (!r) r = &proc_zero;
+	make_prefix(p);
+	make_prefix(r);
+	skip = r->depth > 1 ? r->depth : 1;	/* forest of all processes */
+	i = p->depth - skip;
+	if (i <= 0) {
+		strcpy(buf, "-");
+		return buf;
 	}
-
+	if (i > TREE_DEPTH) {
+		memcpy(s, p->parent->prefix + 2 * skip, 2 * TREE_DEPTH);
+		strcpy(s + 2 * TREE_DEPTH, ".");
+		return buf;
+	}
+	memcpy(s, p->parent->prefix + 2 * skip, 2 * (i - 1));
+	s += 2 * (i - 1);
+	*s++ = ' ';
+	*s++ = p->broth.nx ? '|' : '`';
+	strcpy(s, "-");
 	return buf;
 }
@@ -2,6 +2,24 @@
 #define TREE_DEPTH 32
 #define TREE_STRING_SZ (2 + 2*TREE_DEPTH)
 
+#define COMM_SIZE	32
+
+/*
+ * Snapshot of a single process taken once per tick by for_each_pinfo().
+ * Everything needed to draw and search the tree is read from here,
+ * so /proc is not touched again while lines are printed.
+ */
+struct pinfo {
+	int pid;
+	int ppid;			/* parent pid			*/
+	int tpgid;			/* tty process group id		*/
+	int euid;			/* effective uid		*/
+	char state;			/* process state		*/
+	unsigned long long start_time;	/* start time after boot	*/
+	unsigned long rss;		/* resident set size in kB	*/
+	char comm[COMM_SIZE];		/* name of the executable	*/
+};
+
 struct plist {
 	struct proc_t* nx;
 	struct proc_t** ppv;
@@ -13,10 +31,33 @@ struct proc_t {
 	struct proc_t *child;
 	struct plist mlist;
 	struct plist broth;
-	struct plist hash;
+	struct plist pend;		/* moved or new, needs a line	*/
+	struct pinfo info;		/* last snapshot of the process	*/
+	char *prefix;			/* see tree_string(), 0 if stale */
+	int depth;			/* valid with prefix		*/
+	unsigned int shown;		/* filter pass that kept it	*/
+	bool matched;			/* by the filter, in that pass	*/
 	void* priv;
 };
 
 struct proc_t* tree_start(int root, int start);
 struct proc_t* tree_next();
-char *tree_string(int root, struct proc_t *proc);
+struct proc_t* tree_skip();
+int tree_depth();
+char *tree_string(int root, struct proc_t *proc, char *buf);
+struct pinfo *tree_pinfo(int pid);
+void tree_refresh(struct proc_t *p);
+struct proc_t *tree_pending(void);
+void tree_pending_clear(void);
+struct proc_t *tree_prev(struct proc_t *p);
+bool tree_within(int root, struct proc_t *p);
+void tree_source(void (*scan)(void (*func)(struct pinfo *, void *), void *),
+		 char *(*cmdline)(struct pinfo *));
+char *tree_cmdline(struct pinfo *i);
+
+/* procinfo.c */
+char *cmdline_lookup(struct pinfo *i);
+void cmdline_forget(int pid);
+void owner_forget(int pid);
+void cmdline_stats(unsigned long *hits, unsigned long *misses,
+		   unsigned int *entries);
@@ -0,0 +1,242 @@
+/*
+ * Cost of whowatch itself. The phases of a tick and of a key press
+ * are bracketed with prof_begin() and prof_end(), which take the
+ * time and the read and write system calls and bytes read counted
+ * by the kernel in /proc/self/io. The last PROF_SAMPLES of each
+ * phase are kept. Their median and 99th percentile are shown in
+ * place of the help line after 'p', and SIGUSR1 writes them out.
+ */
+#include "config.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "whowatch.h"
+
+#define PROF_SAMPLES	128
+#define PROF_DUMP	"/tmp/whowatch-%d.prof"
+
+struct io
+{
+	unsigned long long calls;	/* read and write system calls	*/
+	unsigned long long bytes;	/* read				*/
+};
+
+struct sample
+{
+	unsigned long long ns;
+	struct io io;
+};
+
+struct phase
+{
+	const char *name;
+	unsigned long long t0;		/* at prof_begin()		*/
+	struct io io0;
+	bool running;
+	unsigned long long n;		/* samples taken		*/
+	struct sample s[PROF_SAMPLES];	/* the last ones, s[n % size]	*/
+};
+
+static struct phase phases[PROF_PHASES] = {
+	[PROF_TICK] = { "tick" },
+	[PROF_KEY] = { "key" },
+	[PROF_WTMP] = { "wtmp" },
+	[PROF_SCAN] = { "scan" },
+	[PROF_DELETE] = { "delete" },
+	[PROF_SYNC] = { "sync" },
+	[PROF_DRAW] = { "draw" },
+	[PROF_SUB] = { "sub" },
+	[PROF_UPDATE] = { "update" },
+};
+
+static int io_fd = -1;
+static struct io own;			/* what reading io_fd cost	*/
+static bool shown;
+static bool screen;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Counters of the process without the reads done here. The kernel
+ * counts a read after it is done, so a read sees the ones before.
+ */
+static void get_io(struct io *io)
+{
+	unsigned long long rchar, wchar, syscr, syscw;
+	char buf[256];
+	int n;
+
+	memset(io, 0, sizeof *io);
+	if (io_fd == -1) return;
+	if ((n = pread(io_fd, buf, sizeof buf - 1, 0)) <= 0) return;
+	buf[n] = 0;
+	if (sscanf(buf, "rchar: %llu wchar: %llu syscr: %llu syscw: %llu",
+		   &rchar, &wchar, &syscr, &syscw) != 4)
+		return;
+	io->calls = syscr + syscw - own.calls;
+	io->bytes = rchar - own.bytes;
+	own.calls++;
+	own.bytes += n;
+}
+
+void prof_begin(int phase)
+{
+	struct phase *p = &phases[phase];
+
+	get_io(&p->io0);
+	p->t0 = now_ns();
+	p->running = true;
+}
+
+void prof_end(int phase)
+{
+	struct phase *p = &phases[phase];
+	struct sample *s;
+	struct io io;
+
+	if (!p->running) return;
+	p->running = false;
+	s = &p->s[p->n++ % PROF_SAMPLES];
+	s->ns = now_ns() - p->t0;
+	get_io(&io);
+	s->io.calls = io.calls - p->io0.calls;
+	s->io.bytes = io.bytes - p->io0.bytes;
+	trace_event(TR_PHASE, phase, s->ns / 1000, s->io.calls);
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	const unsigned long long *x = a, *y = b;
+
+	return (*x > *y) - (*x < *y);
+}
+
+/*
+ * Median and 99th percentile of a field of the kept samples.
+ */
+static void percentiles(struct phase *p, size_t offset,
+			unsigned long long *p50, unsigned long long *p99)
+{
+	unsigned long long v[PROF_SAMPLES];
+	int i, n = p->n < PROF_SAMPLES ? p->n : PROF_SAMPLES;
+
+	for (i = 0; i < n; i++)
+		v[i] = *(unsigned long long *) ((char *) &p->s[i] + offset);
+	qsort(v, n, sizeof *v, cmp_ull);
+	*p50 = v[n / 2];
+	*p99 = v[(n * 99) / 100];
+}
+
+/*
+ * Text shown in place of the help line. Returns false when it is
+ * not shown.
+ */
+bool prof_status(char *buf, size_t size)
+{
+	unsigned long long t50, t99, c50, b50, x;
+	size_t len = 0;
+	int i;
+
+	if (!shown) return false;
+	len = snprintf(buf, size, "\001p50/p99 ms");
+	for (i = 0; i < PROF_PHASES && len < size; i++) {
+		if (!phases[i].n) continue;
+		percentiles(&phases[i], offsetof(struct sample, ns),
+			    &t50, &t99);
+		percentiles(&phases[i], offsetof(struct sample, io.calls),
+			    &c50, &x);
+		percentiles(&phases[i], offsetof(struct sample, io.bytes),
+			    &b50, &x);
+		len += snprintf(buf + len, size - len,
+				" \002%s\003 %.1f/%.1f", phases[i].name,
+				t50 / 1e6, t99 / 1e6);
+		if (c50 && len < size)
+			len += snprintf(buf + len, size - len, " %lluc %lluk",
+					c50, b50 >> 10);
+	}
+	return true;
+}
+
+const char *prof_name(int phase)
+{
+	if (phase < 0 || phase >= PROF_PHASES) return 0;
+	return phases[phase].name;
+}
+
+bool prof_shown(void)
+{
+	return shown;
+}
+
+void prof_toggle(void)
+{
+	shown = !shown;
+}
+
+static void dump(FILE *f)
+{
+	unsigned long long t50, t99, c50, c99, b50, b99;
+	struct phase *p;
+	int i;
+
+	for (i = 0; i < PROF_PHASES; i++) {
+		p = &phases[i];
+		if (!p->n) continue;
+		percentiles(p, offsetof(struct sample, ns), &t50, &t99);
+		percentiles(p, offsetof(struct sample, io.calls), &c50, &c99);
+		percentiles(p, offsetof(struct sample, io.bytes), &b50, &b99);
+		fprintf(f, "%s n=%llu p50_us=%.1f p99_us=%.1f "
+			"calls_p50=%llu calls_p99=%llu "
+			"bytes_p50=%llu bytes_p99=%llu\n",
+			p->name, p->n, t50 / 1e3, t99 / 1e3, c50, c99,
+			b50, b99);
+	}
+	fflush(f);
+}
+
+/*
+ * The screen is on the terminal, so there it goes to a file.
+ */
+static void dump_signal(int sig)
+{
+	char path[64];
+	FILE *f;
+	int fd;
+
+	if (!screen) {
+		dump(stderr);
+		return;
+	}
+	snprintf(path, sizeof path, PROF_DUMP, (int) getpid());
+	if ((fd = open_dump(path)) == -1) return;
+	if (!(f = fdopen(fd, "w"))) {
+		close(fd);
+		return;
+	}
+	dump(f);
+	fclose(f);
+}
+
+/*
+ * The counters are those of this process, not of the tree given
+ * by --proc.
+ */
+void prof_init(bool on_screen)
+{
+	screen = on_screen;
+	io_fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+	loop_signal(SIGUSR1, dump_signal);
+}
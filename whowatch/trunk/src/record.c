@@ -0,0 +1,843 @@
+/*
+ * Recording of the users list and the process tree, one frame per
+ * tick, and reading it back for replay.
+ *
+ * The file starts with MAGIC and is a sequence of frames: a kind
+ * byte, the length of the payload and the payload. Numbers are
+ * varints, 7 bits a byte with the high bit set on all but the last.
+ * A payload is the time of the tick followed by records:
+ *
+ *	PROC pid mask fields	process is new or the masked fields changed
+ *	GONE pid		process has exited
+ *	USER pid tty mask fields	session is new or has changed
+ *	LOGOUT pid tty		session has ended
+ *
+ * A delta frame has only what changed since the frame before it.
+ * Every KEY_FRAMES frames a key frame has everything, replay can
+ * start there. On exit the offsets of the key frames are written in
+ * an index frame, followed by a trailer that points to it. A file
+ * without it, from a recorder that was killed, is indexed by going
+ * through the frame headers.
+ *
+ * whowatchd passes its snapshots to viewers as key frame payloads.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "whowatch.h"
+#include "proctree.h"
+
+#define MAGIC		"whowatch-rec 2\n"
+#define MAGIC_LEN	(sizeof MAGIC - 1)
+#define TRAILER		"WWINDEX\n"	/* and the index offset, 8 bytes */
+#define TRAILER_LEN	(sizeof TRAILER - 1 + 8)
+
+#define KEY_FRAMES	60
+
+/* frame kinds */
+#define KEY		'K'
+#define DELTA		'D'
+#define INDEX		'I'
+
+/* records */
+#define PROC		1
+#define GONE		2
+#define USER		3
+#define LOGOUT		4
+
+/* fields of PROC */
+#define P_PPID		0x01
+#define P_TPGID		0x02
+#define P_EUID		0x04
+#define P_STATE		0x08
+#define P_START		0x10
+#define P_COMM		0x20
+#define P_CMD		0x40
+#define P_RSS		0x80
+#define P_ALL		0xff
+
+/* fields of USER */
+#define U_NAME		0x01
+#define U_HOST		0x02
+#define U_PARENT	0x04
+#define U_IDLE		0x08
+#define U_WHAT		0x10
+#define U_ALL		0x1f
+
+struct buf
+{
+	unsigned char *p;
+	size_t len, size;
+};
+
+struct cursor
+{
+	const unsigned char *p, *end;
+	bool bad;			/* ran past the end		*/
+};
+
+/*
+ * State after the last frame written or read. Processes and
+ * sessions are hashed by pid.
+ */
+struct rnode
+{
+	struct rnode *next;
+	int pid;
+	unsigned long long seen;	/* frame that has seen it	*/
+};
+
+struct rproc
+{
+	struct rnode n;
+	struct pinfo info;
+	char *cmd;
+};
+
+struct ruser
+{
+	struct rnode n;
+	struct user_t u;
+};
+
+struct table
+{
+	struct rnode **b;
+	unsigned int size, count;	/* size is a power of two	*/
+};
+
+struct key_frame
+{
+	time_t time;
+	off_t off;
+};
+
+static struct table procs, users;
+static struct key_frame *keys;
+static unsigned int nkeys, max_keys;
+
+static void put_byte(struct buf *b, int c)
+{
+	if (b->len == b->size) {
+		b->size = b->size ? b->size * 2 : 4096;
+		b->p = xrealloc(b->p, b->size);
+	}
+	b->p[b->len++] = c;
+}
+
+static void put_varint(struct buf *b, unsigned long long v)
+{
+	for (; v >= 0x80; v >>= 7)
+		put_byte(b, v | 0x80);
+	put_byte(b, v);
+}
+
+/* zigzag, so that -1 takes one byte */
+static void put_svarint(struct buf *b, long long v)
+{
+	put_varint(b, ((unsigned long long) v << 1) ^ (v >> 63));
+}
+
+static void put_str(struct buf *b, const char *s)
+{
+	size_t len = strlen(s);
+
+	put_varint(b, len);
+	while (*s)
+		put_byte(b, *s++);
+}
+
+static int get_byte(struct cursor *c)
+{
+	if (c->p == c->end) {
+		c->bad = true;
+		return 0;
+	}
+	return *c->p++;
+}
+
+static unsigned long long get_varint(struct cursor *c)
+{
+	unsigned long long v = 0;
+	int shift = 0, b;
+
+	do {
+		b = get_byte(c);
+		if (shift < 64) v |= (unsigned long long) (b & 0x7f) << shift;
+		shift += 7;
+	} while (b & 0x80);
+	return v;
+}
+
+static long long get_svarint(struct cursor *c)
+{
+	unsigned long long v = get_varint(c);
+
+	return (v >> 1) ^ -(long long) (v & 1);
+}
+
+/*
+ * Copy a string into size bytes, cutting it if it is longer.
+ */
+static void get_str(struct cursor *c, char *dst, size_t size)
+{
+	size_t len = get_varint(c);
+
+	if (len > c->end - c->p) {
+		c->bad = true;
+		*dst = 0;
+		return;
+	}
+	memcpy(dst, c->p, len < size ? len : size - 1);
+	dst[len < size ? len : size - 1] = 0;
+	c->p += len;
+}
+
+static char *get_strdup(struct cursor *c)
+{
+	size_t len = get_varint(c);
+	char *s;
+
+	if (len > c->end - c->p) {
+		c->bad = true;
+		len = 0;
+	}
+	s = xmalloc(len + 1);
+	memcpy(s, c->p, len);
+	s[len] = 0;
+	c->p += len;
+	return s;
+}
+
+static struct rnode **slot(struct table *t, int pid)
+{
+	return &t->b[(unsigned int) pid * 2654435761u & (t->size - 1)];
+}
+
+static void t_add(struct table *t, struct rnode *n)
+{
+	struct rnode **old = t->b, *p, *next, **s;
+	unsigned int i, size = t->size;
+
+	if (t->count >= t->size) {
+		t->size = t->size ? t->size * 2 : 256;
+		t->b = xcalloc(t->size, sizeof *t->b);
+		for (i = 0; i < size; i++)
+			for (p = old[i]; p; p = next) {
+				next = p->next;
+				s = slot(t, p->pid);
+				p->next = *s;
+				*s = p;
+			}
+		free(old);
+	}
+	s = slot(t, n->pid);
+	n->next = *s;
+	*s = n;
+	t->count++;
+}
+
+static void t_del(struct table *t, struct rnode *n)
+{
+	struct rnode **p;
+
+	for (p = slot(t, n->pid); *p; p = &(*p)->next)
+		if (*p == n) {
+			*p = n->next;
+			t->count--;
+			break;
+		}
+}
+
+static void free_node(struct table *t, struct rnode *n)
+{
+	if (t == &procs) free(((struct rproc *) n)->cmd);
+	else free(((struct ruser *) n)->u.what);
+	free(n);
+}
+
+/*
+ * Remove what frame gen has not seen, or everything. For each
+ * node that goes func is called first, if given.
+ */
+static void t_sweep(struct table *t, unsigned long long gen, bool all,
+		    void (*func)(struct rnode *n))
+{
+	struct rnode **p, *n;
+	unsigned int i;
+
+	for (i = 0; i < t->size; i++)
+		for (p = &t->b[i]; (n = *p); ) {
+			if (!all && n->seen == gen) {
+				p = &n->next;
+				continue;
+			}
+			if (func) func(n);
+			*p = n->next;
+			t->count--;
+			free_node(t, n);
+		}
+}
+
+static struct rproc *find_proc(int pid)
+{
+	struct rnode *n;
+
+	if (!procs.size) return 0;
+	for (n = *slot(&procs, pid); n; n = n->next)
+		if (n->pid == pid) return (struct rproc *) n;
+	return 0;
+}
+
+static struct ruser *find_user(int pid, const char *tty)
+{
+	struct rnode *n;
+
+	if (!users.size) return 0;
+	for (n = *slot(&users, pid); n; n = n->next)
+		if (n->pid == pid && !strcmp(((struct ruser *) n)->u.tty, tty))
+			return (struct ruser *) n;
+	return 0;
+}
+
+static void add_key(time_t t, off_t off)
+{
+	if (nkeys == max_keys) {
+		max_keys = max_keys ? max_keys * 2 : 64;
+		keys = xrealloc(keys, max_keys * sizeof *keys);
+	}
+	keys[nkeys].time = t;
+	keys[nkeys++].off = off;
+}
+
+/*
+ * Writing.
+ */
+static FILE *rec;
+static struct buf frame;
+static unsigned long long frames;	/* written so far		*/
+static time_t last_time;
+
+static void put_proc_fields(struct buf *b, struct pinfo *i, const char *cmd,
+			    int mask)
+{
+	put_byte(b, PROC);
+	put_varint(b, i->pid);
+	put_byte(b, mask);
+	if (mask & P_PPID) put_varint(b, i->ppid);
+	if (mask & P_TPGID) put_svarint(b, i->tpgid);
+	if (mask & P_EUID) put_svarint(b, i->euid);
+	if (mask & P_STATE) put_byte(b, i->state);
+	if (mask & P_START) put_varint(b, i->start_time);
+	if (mask & P_COMM) put_str(b, i->comm);
+	if (mask & P_CMD) put_str(b, cmd);
+	if (mask & P_RSS) put_varint(b, i->rss);
+}
+
+static void put_user_fields(struct buf *b, struct user_t *u, int mask)
+{
+	put_byte(b, USER);
+	put_varint(b, u->pid);
+	put_str(b, u->tty);
+	put_byte(b, mask);
+	if (mask & U_NAME) put_str(b, u->name);
+	if (mask & U_HOST) put_str(b, u->host);
+	if (mask & U_PARENT) put_str(b, u->parent);
+	if (mask & U_IDLE) put_str(b, u->idle);
+	if (mask & U_WHAT) put_str(b, u->what);
+}
+
+static void put_proc(struct pinfo *i, const char *cmd, bool key)
+{
+	struct rproc *r = find_proc(i->pid);
+	struct pinfo *o;
+	int mask = P_ALL;
+
+	if (!r) {
+		r = xcalloc(1, sizeof *r);
+		r->n.pid = i->pid;
+		t_add(&procs, &r->n);
+	} else if (!key) {
+		o = &r->info;
+		mask = 0;
+		if (o->ppid != i->ppid) mask |= P_PPID;
+		if (o->tpgid != i->tpgid) mask |= P_TPGID;
+		if (o->euid != i->euid) mask |= P_EUID;
+		if (o->state != i->state) mask |= P_STATE;
+		if (o->start_time != i->start_time) mask |= P_START;
+		if (strcmp(o->comm, i->comm)) mask |= P_COMM;
+		if (strcmp(r->cmd, cmd)) mask |= P_CMD;
+		if (o->rss != i->rss) mask |= P_RSS;
+	}
+	r->n.seen = frames;
+	if (!mask) return;
+	put_proc_fields(&frame, i, cmd, mask);
+	if (mask & P_CMD) {
+		free(r->cmd);
+		r->cmd = xstrdup(cmd);
+	}
+	r->info = *i;
+}
+
+static void put_gone(struct rnode *n)
+{
+	put_byte(&frame, GONE);
+	put_varint(&frame, n->pid);
+}
+
+static void put_user(struct user_t *u, void *key)
+{
+	struct ruser *r = find_user(u->pid, u->tty);
+	struct user_t *o;
+	int mask = U_ALL;
+
+	if (!r) {
+		r = xcalloc(1, sizeof *r);
+		r->n.pid = u->pid;
+		r->u.pid = u->pid;
+		strcpy(r->u.tty, u->tty);
+		t_add(&users, &r->n);
+	} else if (!*(bool *) key) {
+		o = &r->u;
+		mask = 0;
+		if (strcmp(o->name, u->name)) mask |= U_NAME;
+		if (strcmp(o->host, u->host)) mask |= U_HOST;
+		if (strcmp(o->parent, u->parent)) mask |= U_PARENT;
+		if (strcmp(o->idle, u->idle)) mask |= U_IDLE;
+		if (strcmp(o->what, u->what)) mask |= U_WHAT;
+	}
+	r->n.seen = frames;
+	if (!mask) return;
+	put_user_fields(&frame, u, mask);
+	strcpy(r->u.name, u->name);
+	strcpy(r->u.host, u->host);
+	strcpy(r->u.parent, u->parent);
+	strcpy(r->u.idle, u->idle);
+	if (mask & U_WHAT) {
+		free(r->u.what);
+		r->u.what = xstrdup(u->what);
+	}
+}
+
+static void put_logout(struct rnode *n)
+{
+	put_byte(&frame, LOGOUT);
+	put_varint(&frame, n->pid);
+	put_str(&frame, ((struct ruser *) n)->u.tty);
+}
+
+static void write_frame(int kind, struct buf *b)
+{
+	unsigned char len[10], *p = len;
+	size_t n = b->len;
+
+	for (; n >= 0x80; n >>= 7)
+		*p++ = n | 0x80;
+	*p++ = n;
+	putc(kind, rec);
+	fwrite(len, 1, p - len, rec);
+	fwrite(b->p, 1, b->len, rec);
+}
+
+/*
+ * Write a frame for the current tick. The process tree has to be
+ * up to date.
+ */
+void record_tick(void)
+{
+	bool key = frames % KEY_FRAMES == 0;
+	struct proc_t *p;
+
+	if (!rec) return;
+	frames++;
+	frame.len = 0;
+	last_time = time(0);
+	put_varint(&frame, last_time);
+	for (p = tree_start(0, 0); p; p = tree_next())
+		put_proc(&p->info, tree_cmdline(&p->info), key);
+	t_sweep(&procs, frames, false, put_gone);
+	users_for_each(put_user, &key);
+	t_sweep(&users, frames, false, put_logout);
+
+	if (key) add_key(last_time, ftello(rec));
+	write_frame(key ? KEY : DELTA, &frame);
+	fflush(rec);
+}
+
+static void record_close(void)
+{
+	unsigned char off[8];
+	off_t index;
+	unsigned int i;
+	int j;
+
+	if (!rec) return;
+	frame.len = 0;
+	put_varint(&frame, nkeys);
+	for (i = 0; i < nkeys; i++) {
+		put_varint(&frame, keys[i].time - (i ? keys[i - 1].time : 0));
+		put_varint(&frame, keys[i].off - (i ? keys[i - 1].off : 0));
+	}
+	put_varint(&frame, last_time);
+	index = ftello(rec);
+	write_frame(INDEX, &frame);
+	for (j = 0; j < 8; j++)
+		off[j] = (unsigned long long) index >> (8 * j);
+	fputs(TRAILER, rec);
+	fwrite(off, 1, sizeof off, rec);
+	fclose(rec);
+	rec = 0;
+}
+
+static struct buf snap;
+
+static void snap_user(struct user_t *u, void *unused)
+{
+	put_user_fields(&snap, u, U_ALL);
+}
+
+/*
+ * Everything as the payload of a key frame, for whowatchd. It is
+ * not a part of the recording. The buffer is valid until the next
+ * call.
+ */
+size_t record_snapshot(const unsigned char **p)
+{
+	struct proc_t *q;
+
+	snap.len = 0;
+	put_varint(&snap, time(0));
+	for (q = tree_start(0, 0); q; q = tree_next())
+		put_proc_fields(&snap, &q->info, tree_cmdline(&q->info), P_ALL);
+	users_for_each(snap_user, 0);
+	*p = snap.p;
+	return snap.len;
+}
+
+/*
+ * Start recording to path, the file is overwritten.
+ */
+bool record_open(const char *path)
+{
+	if (!(rec = fopen(path, "w"))) return false;
+	fputs(MAGIC, rec);
+	atexit(record_close);
+	return true;
+}
+
+/*
+ * Reading.
+ */
+static FILE *play;
+static off_t play_pos;			/* next frame			*/
+static time_t play_time;		/* of the last frame applied	*/
+static time_t first_time, end_time;
+static struct buf payload;
+
+/*
+ * Read the frame header at off. Returns its kind or EOF.
+ */
+static int read_header(off_t off, size_t *len)
+{
+	int kind, c, shift = 0;
+
+	if (fseeko(play, off, SEEK_SET) == -1) return EOF;
+	if ((kind = getc(play)) == EOF) return EOF;
+	*len = 0;
+	do {
+		if ((c = getc(play)) == EOF || shift > 56) return EOF;
+		*len |= (size_t) (c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return kind;
+}
+
+/*
+ * Read the frame at off into payload. Returns its kind, and sets
+ * next to the offset of the following frame.
+ */
+static int read_frame(off_t off, off_t *next)
+{
+	size_t len;
+	int kind;
+
+	if ((kind = read_header(off, &len)) == EOF) return EOF;
+	if (len > payload.size) {
+		payload.size = len;
+		payload.p = xrealloc(payload.p, len);
+	}
+	if (fread(payload.p, 1, len, play) != len) return EOF;
+	payload.len = len;
+	*next = ftello(play);
+	return kind;
+}
+
+static time_t frame_time(void)
+{
+	struct cursor c = { payload.p, payload.p + payload.len };
+
+	return get_varint(&c);
+}
+
+/*
+ * The index written by record_close().
+ */
+static bool read_index(void)
+{
+	unsigned char t[TRAILER_LEN];
+	struct cursor c;
+	time_t tm = 0;
+	off_t off = 0, next;
+	unsigned int i, n;
+	int j;
+
+	if (fseeko(play, -(off_t) TRAILER_LEN, SEEK_END) == -1 ||
+	    fread(t, 1, TRAILER_LEN, play) != TRAILER_LEN ||
+	    memcmp(t, TRAILER, sizeof TRAILER - 1))
+		return false;
+	for (j = 7; j >= 0; j--)
+		off = off << 8 | t[sizeof TRAILER - 1 + j];
+	if (read_frame(off, &next) != INDEX) return false;
+	c.p = payload.p;
+	c.end = payload.p + payload.len;
+	c.bad = false;
+	n = get_varint(&c);
+	for (i = 0, off = 0; i < n && !c.bad; i++) {
+		tm += get_varint(&c);
+		off += get_varint(&c);
+		add_key(tm, off);
+	}
+	end_time = get_varint(&c);
+	return !c.bad;
+}
+
+/*
+ * No index, look at every frame.
+ */
+static void scan_index(void)
+{
+	off_t off = MAGIC_LEN, next;
+	int kind;
+
+	nkeys = 0;
+	while ((kind = read_frame(off, &next)) == KEY || kind == DELTA) {
+		end_time = frame_time();
+		if (kind == KEY) add_key(end_time, off);
+		off = next;
+	}
+}
+
+static struct rproc *new_proc(int pid)
+{
+	struct rproc *r = xcalloc(1, sizeof *r);
+
+	r->n.pid = r->info.pid = pid;
+	t_add(&procs, &r->n);
+	return r;
+}
+
+static void get_proc(struct cursor *c)
+{
+	int pid = get_varint(c), mask = get_byte(c);
+	struct rproc *r = find_proc(pid);
+
+	if (!r) r = new_proc(pid);
+	if (mask & P_PPID) r->info.ppid = get_varint(c);
+	if (mask & P_TPGID) r->info.tpgid = get_svarint(c);
+	if (mask & P_EUID) r->info.euid = get_svarint(c);
+	if (mask & P_STATE) r->info.state = get_byte(c);
+	if (mask & P_START) r->info.start_time = get_varint(c);
+	if (mask & P_COMM) get_str(c, r->info.comm, sizeof r->info.comm);
+	if (mask & P_CMD) {
+		free(r->cmd);
+		r->cmd = get_strdup(c);
+	}
+	if (mask & P_RSS) r->info.rss = get_varint(c);
+}
+
+static void get_user(struct cursor *c)
+{
+	char tty[sizeof ((struct user_t *) 0)->tty];
+	int pid = get_varint(c), mask;
+	struct ruser *r;
+	struct user_t *u;
+
+	get_str(c, tty, sizeof tty);
+	mask = get_byte(c);
+	if (!(r = find_user(pid, tty))) {
+		r = xcalloc(1, sizeof *r);
+		r->n.pid = r->u.pid = pid;
+		strcpy(r->u.tty, tty);
+		r->u.what = xstrdup("");
+		t_add(&users, &r->n);
+	}
+	u = &r->u;
+	if (mask & U_NAME) get_str(c, u->name, sizeof u->name);
+	if (mask & U_HOST) get_str(c, u->host, sizeof u->host);
+	if (mask & U_PARENT) get_str(c, u->parent, sizeof u->parent);
+	if (mask & U_IDLE) get_str(c, u->idle, sizeof u->idle);
+	if (mask & U_WHAT) {
+		free(u->what);
+		u->what = get_strdup(c);
+	}
+}
+
+static void apply(int kind)
+{
+	struct cursor c = { payload.p, payload.p + payload.len };
+	struct rnode *n;
+	char tty[sizeof ((struct user_t *) 0)->tty];
+	int pid;
+
+	if (kind == KEY) {
+		t_sweep(&procs, 0, true, 0);
+		t_sweep(&users, 0, true, 0);
+	}
+	play_time = get_varint(&c);
+	while (c.p < c.end && !c.bad) {
+		switch (get_byte(&c)) {
+		case PROC:
+			get_proc(&c);
+			break;
+		case GONE:
+			if ((n = (struct rnode *) find_proc(get_varint(&c)))) {
+				t_del(&procs, n);
+				free_node(&procs, n);
+			}
+			break;
+		case USER:
+			get_user(&c);
+			break;
+		case LOGOUT:
+			pid = get_varint(&c);
+			get_str(&c, tty, sizeof tty);
+			if ((n = (struct rnode *) find_user(pid, tty))) {
+				t_del(&users, n);
+				free_node(&users, n);
+			}
+			break;
+		default:
+			c.bad = true;
+		}
+	}
+}
+
+/*
+ * Apply the next frame if it is not later than t. Returns false
+ * if it is, or if the recording has ended.
+ */
+bool replay_step(time_t t)
+{
+	off_t next;
+	int kind = read_frame(play_pos, &next);
+
+	if ((kind != KEY && kind != DELTA) || frame_time() > t)
+		return false;
+	apply(kind);
+	play_pos = next;
+	return true;
+}
+
+/*
+ * Go to the last frame not later than t, starting from the key
+ * frame before it. Before the first frame it is the first one.
+ */
+void replay_seek(time_t t)
+{
+	unsigned int lo = 0, hi = nkeys, mid;
+
+	if (!nkeys) return;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (keys[mid].time <= t) lo = mid;
+		else hi = mid;
+	}
+	play_pos = keys[lo].off;
+	if (!replay_step(t > keys[lo].time ? t : keys[lo].time)) return;
+	while (replay_step(t)) ;
+}
+
+bool replay_open(const char *path)
+{
+	char magic[MAGIC_LEN];
+
+	if (!(play = fopen(path, "r"))) return false;
+	if (fread(magic, 1, MAGIC_LEN, play) != MAGIC_LEN ||
+	    memcmp(magic, MAGIC, MAGIC_LEN)) {
+		fclose(play);
+		play = 0;
+		return false;
+	}
+	if (!read_index()) scan_index();
+	first_time = nkeys ? keys[0].time : 0;
+	replay_seek(first_time);
+	return true;
+}
+
+/*
+ * Make the state the one of a snapshot from record_snapshot().
+ */
+void replay_load(const unsigned char *p, size_t len)
+{
+	if (len > payload.size) {
+		payload.size = len;
+		payload.p = xrealloc(payload.p, len);
+	}
+	memcpy(payload.p, p, len);
+	payload.len = len;
+	apply(KEY);
+}
+
+/*
+ * Times of the last frame applied, of the first and of the last
+ * one in the file.
+ */
+void replay_times(time_t *now, time_t *first, time_t *last)
+{
+	*now = play_time;
+	*first = first_time;
+	*last = end_time;
+}
+
+/*
+ * The state after the last frame or snapshot applied, in the shape of
+ * for_each_pinfo(), cmdline_lookup() and users_for_each().
+ */
+void replay_procs(void (*func)(struct pinfo *i, void *data), void *data)
+{
+	struct rnode *n;
+	struct pinfo *p;
+	unsigned int i;
+
+	for (i = 0; i < procs.size; i++)
+		for (n = procs.b[i]; n; n = n->next) {
+			p = &((struct rproc *) n)->info;
+			/* not from a real scan, the tree can't hold it */
+			if (p->pid > 0 && p->ppid >= 0) func(p, data);
+		}
+}
+
+char *replay_cmdline(struct pinfo *i)
+{
+	struct rproc *r = find_proc(i->pid);
+
+	if (!full_cmd || !r || !r->cmd) return i->comm;
+	return r->cmd;
+}
+
+int replay_users(void (*func)(struct user_t *u, void *data), void *data)
+{
+	struct rnode *n;
+	unsigned int i;
+	int count = 0;
+
+	for (i = 0; i < users.size; i++)
+		for (n = users.b[i]; n; n = n->next, count++)
+			func(&((struct ruser *) n)->u, data);
+	return count;
+}
@@ -0,0 +1,143 @@
+/*
+ * Replay of a recording made with --record. The users list and the
+ * process tree are fed from the file instead of utmp and /proc. The
+ * replay clock runs at a chosen speed and every tick the frames up
+ * to it are applied; it can be stopped and moved around.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include "whowatch.h"
+#include "proctree.h"
+
+#define SEEK_STEP	60		/* seconds, < and >		*/
+#define SEEK_JUMP	(10 * 60)	/* [ and ]			*/
+#define MAX_SPEED	64
+
+static bool replaying;
+static bool paused;
+static int speed = 1;			/* negative: 1/-speed		*/
+static int interval;
+static time_t clock_;			/* where the replay is		*/
+
+static void show(void)
+{
+	time_t now, first, last;
+
+	while (replay_step(clock_)) ;
+	replay_times(&now, &first, &last);
+	if (clock_ >= last) {
+		clock_ = last;
+		paused = true;
+	}
+	users_sync(replay_users);
+}
+
+/*
+ * Called every tick, n ticks have passed.
+ */
+void replay_tick(unsigned long long n)
+{
+	static int part;		/* of a second at slow speed	*/
+
+	if (!replaying || paused) return;
+	if (speed > 0) {
+		clock_ += n * interval * speed;
+	} else {
+		part += n * interval;
+		clock_ += part / -speed;
+		part %= -speed;
+	}
+	show();
+}
+
+static void seek(long d)
+{
+	time_t now, first, last;
+
+	replay_times(&now, &first, &last);
+	clock_ += d;
+	if (clock_ < first) clock_ = first;
+	if (clock_ > last) clock_ = last;
+	replay_seek(clock_);
+	show();
+	if (current != &history_win) current->periodic();
+	update_load();
+}
+
+bool replay_keys(int key)
+{
+	if (!replaying) return KEY_SKIPPED;
+	switch (key) {
+	case ' ':
+		paused = !paused;
+		break;
+	case '+':
+		if (speed == -2) speed = 1;
+		else if (speed < 0) speed /= 2;
+		else if (speed < MAX_SPEED) speed *= 2;
+		break;
+	case '-':
+		if (speed == 1) speed = -2;
+		else if (speed > 0) speed /= 2;
+		else if (speed > -MAX_SPEED) speed *= 2;
+		break;
+	case '<':
+		seek(-SEEK_STEP);
+		return KEY_HANDLED;
+	case '>':
+		seek(SEEK_STEP);
+		return KEY_HANDLED;
+	case '[':
+		seek(-SEEK_JUMP);
+		return KEY_HANDLED;
+	case ']':
+		seek(SEEK_JUMP);
+		return KEY_HANDLED;
+	default:
+		return KEY_SKIPPED;
+	}
+	update_load();
+	return KEY_HANDLED;
+}
+
+bool replay_active(void)
+{
+	return replaying;
+}
+
+/*
+ * Text shown in place of the load average. Returns false when
+ * nothing is replayed.
+ */
+bool replay_status(char *buf, size_t size)
+{
+	char when[32];
+
+	if (!replaying) return false;
+	strftime(when, sizeof when, "%b %e %H:%M:%S", localtime(&clock_));
+	if (speed > 0)
+		snprintf(buf, size, "replay %s x%d%s", when, speed,
+			 paused ? " paused" : "");
+	else snprintf(buf, size, "replay %s x1/%d%s", when, -speed,
+		      paused ? " paused" : "");
+	return true;
+}
+
+/*
+ * Open the recording and show its start, sec is the tick length.
+ */
+bool replay_init(const char *path, int sec)
+{
+	time_t now, first, last;
+
+	if (!replay_open(path)) return false;
+	replaying = true;
+	interval = sec;
+	replay_times(&now, &first, &last);
+	clock_ = first;
+	tree_source(replay_procs, replay_cmdline);
+	return true;
+}
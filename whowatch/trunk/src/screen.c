@@ -23,9 +23,10 @@ WINDOW *main_win;
 
 static char *help_line[] = 
 	{
-	"\001[F1]Help [F9]Menu [ENT]proc all[t]ree [i]dle/cmd [c]md [d]etails [s]ysinfo",
+	"\001[F1]Help [F9]Menu [ENT]proc all[t]ree [h]istory [i]dle/cmd [c]md [d]etails [s]ysinfo",
 	"\001[ENT]users [c]md all[t]ree [d]etails [o]wner [s]ysinfo sig[l]ist ^[K]ILL",
 	"\001[ENT]users [c]md [d]etails [o]owner [s]ysinfo sig[l]ist ^[K]ILL",
+	"\001[F1]Help [F9]Menu [ENT]users [d]etails [s]ysinfo [/]search",
 	};
 
 static void alloc_color(void)
@@ -39,6 +40,7 @@ static void alloc_color(void)
 	init_pair(7,COLOR_RED, COLOR_CYAN);
  	init_pair(8,COLOR_BLACK, COLOR_CYAN);
  	init_pair(9,COLOR_BLACK, COLOR_WHITE);
+	init_pair(MATCH_COLOR, COLOR_BLACK, COLOR_YELLOW);
 }
 
 #define RESERVED_LINES		3	/* reserved space for help info */
@@ -53,8 +55,9 @@ void win_init(void)
 	bzero(curs_buf, sizeof(chtype) * screen_cols);
 	users_list.rows = screen_rows - RESERVED_LINES - 1;
 	users_list.cols = screen_cols - 2; 	
-	proc_win.rows = users_list.rows;
+	proc_win.rows = history_win.rows = users_list.rows;
 	info_win.cols = help_win.cols = proc_win.cols = users_list.cols;
+	history_win.cols = users_list.cols;
 }	
 
 void curses_init()
@@ -63,6 +66,7 @@ void curses_init()
 	initscr();
 	users_list.wd = newwin(users_list.rows + 1, COLS, 2 ,0);
 	proc_win.wd = users_list.wd;
+	history_win.wd = users_list.wd;
 
 	help_win.wd = newwin(1, COLS, users_list.rows + RESERVED_LINES, 0);
 	info_win.wd = newwin(2, COLS, 0, 0);
@@ -133,7 +137,10 @@ wtouchln(w->wd, line, 1, 1);
 	for(i = 0; i <= w->cols; i++) { 
 		c = mvwinch(w->wd, line, i);
 		curs_buf[i] = c;
-		waddch(w->wd, c & A_CHARTEXT);
+		/* a match stays marked */
+		if (PAIR_NUMBER(c & A_COLOR) == MATCH_COLOR)
+			waddch(w->wd, c & (A_CHARTEXT | A_COLOR));
+		else waddch(w->wd, c & A_CHARTEXT);
 	}
 	curs_buf[i] = 0;
 	wattrset(w->wd, A_BOLD);
@@ -163,22 +170,33 @@ static void move_cursor(struct window *w, int from, int to)
 }
 
 /*
- * parse string and print line with colors
+ * Print s with colors, the part from..to of it is highlighted.
  */
-int echo_line (struct window *w, const char *s, int line)
+static int draw_line(struct window *w, const char *s, int line, int from,
+		     int to)
 {
 	const char *p = s, *q = s;
+	attr_t attr = getattrs(w->wd);	/* outside the highlight */
 	int i = 0;
 	if (!p) return 1;
 	wmove(w->wd, line, 0);
 	wclrtoeol(w->wd);
 	while(*p){
 		if (i > w->cols) break;
+		if (p - s == from || p - s == to) {
+			if(p - q != 0)
+				waddnstr(w->wd, q, p - q);
+			wattrset(w->wd, p - s == from ?
+				 COLOR_PAIR(MATCH_COLOR) : attr);
+			q = p;
+		}
 		if (*p < 17){
 			i--;
 			if(p - q != 0)
 				waddnstr(w->wd, q, p - q);
-			wattrset(w->wd, COLOR_PAIR(*p));
+			attr = COLOR_PAIR(*p);
+			if (p - s < from || p - s >= to)
+				wattrset(w->wd, attr);
 			q = p + 1;
 		}
 		p++;
@@ -186,12 +204,27 @@ int echo_line (struct window *w, const char *s, int line)
 	}
 	waddnstr(w->wd, q, p - q);
 	return 0;
+}
+
+/*
+ * parse string and print line with colors
+ */
+int echo_line (struct window *w, const char *s, int line)
+{
+	return draw_line(w, s, line, -1, -1);
 }	
 
 void print_help()
 {
+	char buf[256];
 	int i = 0;
+	if (prof_status(buf, sizeof buf)) {
+		echo_line(&help_win, buf, 0);
+		wnoutrefresh(help_win.wd);
+		return;
+	}
 	if(current == &proc_win) i = 1; 
+	if(current == &history_win) i = 3;
 	echo_line(&help_win, help_line[i], 0);
 	wnoutrefresh(help_win.wd);
 }
@@ -199,9 +232,13 @@ void print_help()
 void update_load()
 {
 	double d[3] = { 0, 0, 0};
-	char buf[32];
-	if(info_win.cols < 65 || getloadavg(d, 3) == -1) return;
-	snprintf(buf, sizeof buf, "load: %.2f, %.2f, %.2f", d[0], d[1], d[2]);
+	char buf[64];
+	if(info_win.cols < 65) return;
+	if(!replay_status(buf, sizeof buf)) {
+		if(getloadavg(d, 3) == -1) return;
+		snprintf(buf, sizeof buf, "load: %.2f, %.2f, %.2f",
+			 d[0], d[1], d[2]);
+	}
 	wmove(info_win.wd, 0, screen_cols - strlen(buf));
 	wattrset(info_win.wd, COLOR_PAIR(3));
 	waddstr(info_win.wd, buf);
@@ -253,12 +290,14 @@ static bool at_end(int line, struct window *w)
  */	
 int print_line(struct window *w, const char *s, int line, bool virtual)
 {
-	int r = scr_line(line, w);
+	int r = scr_line(line, w), from, to;
 
 	/* line is below screen */
 //	if(below(line, w)) return 0;
 
-	if (!virtual) echo_line(w, s, r);
+	if (!virtual && search_span(s, &from, &to))
+		draw_line(w, s, r, from, to);
+	else if (!virtual) echo_line(w, s, r);
 	
 	/* printed line is at the cursor position */
 	if (r == w->cursor && !virtual)
@@ -1,46 +1,312 @@
+/*
+ * Searching the lines of a window. The pattern is compiled once and
+ * kept, so 'n' and 'N' go to the next and previous match and the
+ * matching part of every drawn line is highlighted. The search box
+ * searches as you type, ESC or Cancel puts the cursor back and
+ * forgets the pattern.
+ *
+ * A window that can tell whether its line matches (match() of
+ * struct window) gets a list of its matching lines, made once for
+ * the data shown and kept until a tick or a key changes it, so
+ * moving between matches doesn't test the lines again. Other
+ * windows are searched line by line from the cursor.
+ *
+ * Most patterns are plain words. The longest run of characters that
+ * every match has to contain is looked up first with a simple
+ * substring search, and regexec() is left out when the pattern is
+ * nothing but that.
+ */
 #include "config.h"
-#include "whowatch.h"
+
+#include <ctype.h>
 #include <regex.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "whowatch.h"
 
 static char prev_search[64];
-//static struct window *prev;
-static regex_t cur_reg;
+static regex_t cur_reg;			/* REG_NOSUB, tests lines	*/
+static regex_t span_reg;		/* finds the part to highlight	*/
+static bool compiled;
+static char literal[64];		/* in every match, may be ""	*/
+static bool only_literal;		/* the pattern is just literal	*/
+
+/* lines that match, made for map_win at map_ticks */
+static struct window *map_win;
+static unsigned long long map_ticks;
+static int *matches, nmatches, matches_size;
+static int at;				/* index of the last one visited */
 
-/* 
- * Called by getprocbyname() and user_search(), instead of simple strncmp().
+/* where the cursor was when the search box was opened */
+static struct window *origin_win;
+static int origin_line = -1;
+
+/*
+ * Case insensitive strstr(), needle is lower case.
+ */
+static const char *find_literal(const char *s, const char *needle)
+{
+	size_t n = strlen(needle);
+
+	for (; *s; s++)
+		if (tolower((unsigned char) *s) == *needle &&
+		    !strncasecmp(s, needle, n))
+			return s;
+	return 0;
+}
+
+/*
+ * Find the longest run of plain characters that every match of
+ * the pattern contains. Only the top level of patterns without
+ * alternation is looked at, anything doubtful ends a run.
+ */
+static void find_required(const char *p)
+{
+	static const char special[] = ".[]()*+?{}|^$\\";
+	char run[sizeof literal];
+	int len = 0, best = 0, depth = 0;
+	bool plain = true;
+
+	literal[0] = 0;
+	only_literal = false;
+	if (strchr(p, '|')) return;
+	for (; *p; p++) {
+		if (depth || strchr(special, *p)) {
+			plain = false;
+			if (*p == '(') depth++;
+			if (*p == ')' && depth) depth--;
+			if (*p == '[') {
+				/* a bracket expression, ] first is literal */
+				if (p[1] == '^') p++;
+				if (p[1] == ']') p++;
+				while (p[1] && p[1] != ']') p++;
+				if (p[1]) p++;
+			}
+			if (*p == '{')		/* a bound, {2} or {1,3} */
+				while (p[1] && *p != '}') p++;
+			if (*p == '\\' && p[1])	/* and what it escapes */
+				p++;
+			if (len > best) {
+				best = len;
+				memcpy(literal, run, len);
+				literal[len] = 0;
+			}
+			len = 0;
+			continue;
+		}
+		/* what is before a quantifier may not be there */
+		if (p[1] && strchr("*?{", p[1])) {
+			plain = false;
+			continue;
+		}
+		if (len < sizeof run - 1)
+			run[len++] = tolower((unsigned char) *p);
+		else plain = false;	/* longer than literal holds */
+	}
+	if (len > best) {
+		memcpy(literal, run, len);
+		literal[len] = 0;
+	}
+	only_literal = plain && *literal;
+}
+
+static void forget_pattern(void)
+{
+	if (compiled) {
+		regfree(&cur_reg);
+		regfree(&span_reg);
+	}
+	compiled = false;
+	prev_search[0] = 0;
+	search_forget();
+}
+
+/*
+ * Make s the pattern unless it already is. Returns false if it is
+ * not a regular expression, the error is in err then.
+ */
+static bool set_pattern(const char *s, char *err, size_t size)
+{
+	regex_t r;
+	int e;
+
+	if (compiled && !strcmp(s, prev_search)) return true;
+	e = regcomp(&r, s, REG_EXTENDED | REG_ICASE | REG_NOSUB);
+	if (e) {
+		regerror(e, &r, err, size);
+		return false;
+	}
+	forget_pattern();
+	cur_reg = r;
+	regcomp(&span_reg, s, REG_EXTENDED | REG_ICASE);
+	compiled = true;
+	snprintf(prev_search, sizeof prev_search, "%s", s);
+	find_required(s);
+	return true;
+}
+
+/*
+ * Called by the match() of windows and by history_search().
  */
 bool reg_match(const char *s)
 {
-  return (regexec(&cur_reg, s, 0, 0, REG_NOTEOL) == 0); 
+	if (!compiled) return false;
+	if (*literal && !find_literal(s, literal)) return false;
+	if (only_literal) return true;
+	return regexec(&cur_reg, s, 0, 0, REG_NOTEOL) == 0;
+}
+
+/*
+ * The part of a drawn line to highlight, false if none.
+ */
+bool search_span(const char *s, int *from, int *to)
+{
+	regmatch_t m;
+	const char *p;
+
+	if (!compiled || !s) return false;
+	if (only_literal) {
+		if (!(p = find_literal(s, literal))) return false;
+		*from = p - s;
+		*to = *from + strlen(literal);
+		return true;
+	}
+	if (*literal && !find_literal(s, literal)) return false;
+	if (regexec(&span_reg, s, 1, &m, REG_NOTEOL) ||
+	    m.rm_eo <= m.rm_so)
+		return false;
+	*from = m.rm_so;
+	*to = m.rm_eo;
+	return true;
+}
+
+/*
+ * The lines of the window changed, the list of matches is made
+ * again when it is needed.
+ */
+void search_forget(void)
+{
+	map_win = 0;
+}
+
+static void make_map(struct window *w)
+{
+	int l;
+
+	if (map_win == w && map_ticks == ticks) return;
+	nmatches = at = 0;
+	for (l = 0; l < w->d_lines; l++) {
+		if (!w->match(l)) continue;
+		if (nmatches == matches_size) {
+			matches_size = matches_size ? 2 * matches_size : 64;
+			matches = xrealloc(matches,
+					   matches_size * sizeof *matches);
+		}
+		matches[nmatches++] = l;
+	}
+	map_win = w;
+	map_ticks = ticks;
+}
+
+/*
+ * Next match after line, or before it if back, going around the
+ * end. -1 if there is none.
+ */
+static int map_next(int line, bool back)
+{
+	int lo = 0, hi = nmatches;
+
+	if (!nmatches) return -1;
+	if (matches[at] == line) {
+		/* moving from match to match */
+		at = (at + (back ? nmatches - 1 : 1)) % nmatches;
+		return matches[at];
+	}
+	while (lo < hi) {		/* first one after line */
+		int mid = (lo + hi) / 2;
+		if (matches[mid] <= line) lo = mid + 1;
+		else hi = mid;
+	}
+	if (back) at = (lo + nmatches - 1 - (lo && matches[lo - 1] == line))
+			% nmatches;
+	else at = lo % nmatches;
+	return matches[at];
+}
+
+/*
+ * Line with a match after the cursor line, or from it if here.
+ */
+static int find(int line, bool here, bool back)
+{
+	if (current->match) {
+		make_map(current);
+		return map_next(here ? line - 1 : line, back);
+	}
+	/* only the history, which is read as it is searched */
+	if (back || current != &history_win) return -1;
+	return history_search(here ? line : line + 1);
+}
+
+static void go(int line)
+{
+	if (line < 0) return;
+	to_line(line, current);
+	current->redraw();
+	pad_draw();
+	trace_event(TR_SEARCH, line, nmatches, 0);
 }
 
 void do_search (const char *s)
 {
-	unsigned int p;
-	int err;
 	static char errbuf[64];
 
-	err = regcomp(&cur_reg, s, REG_EXTENDED | REG_ICASE | REG_NOSUB);
-	if (err != 0) {
-		regerror(err, &cur_reg, errbuf, sizeof errbuf);
+	if (!set_pattern(s, errbuf, sizeof errbuf)) {
+		origin_line = -1;
 		info_box(" Regex error ", errbuf);
 		return;
 	}
-	if(current == &proc_win)
-		p = getprocbyname(current->cursor + current->offset);
-	else p = user_search(current->cursor + current->offset);
-	
-	snprintf(prev_search, sizeof prev_search, "%s", s);
 	set_search(prev_search);
-	regfree(&cur_reg);
-	if(p == -1) return;
-	/* move the cursor to appropriate line */
-	to_line(p, current);
-	pad_draw();
-	dolog("%s: %d\n", __FUNCTION__, p);
+	if (origin_win == current && origin_line >= 0) {
+		/* typing found it already */
+		origin_line = -1;
+		current->redraw();
+		return;
+	}
+	go(find(current->cursor + current->offset, false, false));
 }
 
+/*
+ * Called as the pattern is typed, s is 0 when the box is closed
+ * without searching.
+ */
+void search_typed(char *s)
+{
+	char err[64];
+	int l;
 
+	if (origin_win != current || origin_line < 0) {
+		origin_win = current;
+		origin_line = current->cursor + current->offset;
+	}
+	if (!s || !*s) {
+		forget_pattern();
+		to_line(origin_line, current);
+		current->redraw();
+		if (!s) origin_line = -1;
+		return;
+	}
+	/* half typed patterns are often not valid, wait for more */
+	if (!set_pattern(s, err, sizeof err)) return;
+	if ((l = find(origin_line, true, false)) < 0) l = origin_line;
+	go(l);
+}
 
-
+/*
+ * 'n' and 'N', next or previous match of the last pattern.
+ */
+void search_next(bool back)
+{
+	if (!compiled) return;
+	go(find(current->cursor + current->offset, false, back));
+}
@@ -0,0 +1,249 @@
+/*
+ * Sharing one scanner between many viewers. whowatchd scans /proc
+ * and follows wtmp, and every tick publishes a snapshot of the
+ * users and processes in shared memory. A viewer that finds it
+ * running takes its snapshots instead of scanning by itself.
+ *
+ * The region has two slots. The writer fills the one that is not
+ * published and then publishes it, so a reader copies a slot that
+ * is not being written unless it is two snapshots behind. Each slot
+ * has a sequence number, odd while it is written, which tells the
+ * reader that its copy is torn and has to be taken again. Readers
+ * never write to the region and the writer never waits for them.
+ *
+ * Anybody can make an object of that name, so it is used only if
+ * it belongs to root or to us and nobody else can write to it.
+ */
+#include "config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "whowatch.h"
+#include "proctree.h"
+#include "machine.h"
+
+#define SHM_NAME	"/whowatch"
+#define SHM_MAGIC	"whowatchd 2"
+#define SHM_HEAD	4096
+#define SHM_SLOT	(16 << 20)	/* pages are used only when written */
+#define SHM_SIZE	(SHM_HEAD + 2 * SHM_SLOT)
+#define READ_TRIES	8
+
+struct shm_slot
+{
+	unsigned long long seq;		/* odd while being written	*/
+	unsigned long long len;
+};
+
+struct shm_head
+{
+	char magic[16];
+	int pid;			/* of whowatchd			*/
+	int interval;			/* its tick			*/
+	unsigned long long gen;		/* the last one is in slot gen & 1 */
+	struct shm_slot slot[2];
+};
+
+static struct shm_head *head;
+static unsigned char *copy;		/* reader's copy of a snapshot	*/
+static unsigned long long seen;		/* gen of the last one read	*/
+
+static unsigned char *slot_data(int i)
+{
+	return (unsigned char *) head + SHM_HEAD + (size_t) i * SHM_SLOT;
+}
+
+static bool alive(int pid)
+{
+	return pid > 0 && (!kill(pid, 0) || errno == EPERM);
+}
+
+static bool trusted(int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) == -1) return false;
+	return (st.st_uid == 0 || st.st_uid == geteuid()) &&
+		!(st.st_mode & (S_IWGRP | S_IWOTH)) && st.st_size >= SHM_SIZE;
+}
+
+/*
+ * Server side.
+ */
+static void publish(const unsigned char *p, size_t len)
+{
+	int i = (head->gen + 1) & 1;
+	struct shm_slot *s = &head->slot[i];
+
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(slot_data(i), p, len);
+	s->len = len;
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&head->gen, head->gen + 1, __ATOMIC_RELEASE);
+}
+
+static void no_del(void *unused)
+{
+}
+
+void daemon_tick(unsigned long long n)
+{
+	const unsigned char *p;
+	size_t len;
+
+	ticks += n;
+	prof_begin(PROF_TICK);
+	check_wtmp();
+	if (tree_stale()) update_tree(no_del);
+	tree_pending_clear();
+	record_tick();
+	if ((len = record_snapshot(&p)) > SHM_SLOT)
+		warnx("snapshot of %zu bytes does not fit", len);
+	else publish(p, len);
+	prof_end(PROF_TICK);
+}
+
+static void daemon_exit(void)
+{
+	if (head && head->pid == getpid()) {
+		head->pid = 0;
+		shm_unlink(SHM_NAME);
+	}
+}
+
+static void daemon_signal(int sig)
+{
+	exit(EXIT_SUCCESS);
+}
+
+/*
+ * Create the region, there can be only one whowatchd.
+ */
+void daemon_init(int interval)
+{
+	struct shm_head *old;
+	int fd;
+
+	if ((fd = shm_open(SHM_NAME, O_RDONLY, 0)) != -1) {
+		if (!trusted(fd))
+			errx(EXIT_FAILURE, "shared memory %s is not ours, "
+			     "remove it first", SHM_NAME);
+		old = mmap(0, SHM_HEAD, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (old != MAP_FAILED) {
+			if (!memcmp(old->magic, SHM_MAGIC, sizeof SHM_MAGIC) &&
+			    alive(old->pid))
+				errx(EXIT_FAILURE, "already running as %d",
+				     old->pid);
+			munmap(old, SHM_HEAD);
+		}
+		shm_unlink(SHM_NAME);
+	}
+	fd = shm_open(SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd == -1)
+		err(EXIT_FAILURE, "shm_open %s", SHM_NAME);
+	fchmod(fd, 0644);
+	if (ftruncate(fd, SHM_SIZE) == -1)
+		err(EXIT_FAILURE, "ftruncate");
+	head = mmap(0, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (head == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap");
+	close(fd);
+	head->pid = getpid();
+	head->interval = interval;
+	memcpy(head->magic, SHM_MAGIC, sizeof SHM_MAGIC);
+	atexit(daemon_exit);
+	loop_signal(SIGINT, daemon_signal);
+	loop_signal(SIGTERM, daemon_signal);
+	loop_signal(SIGHUP, daemon_signal);
+}
+
+/*
+ * Viewer side.
+ */
+
+/*
+ * Use the snapshots of a running whowatchd. Returns false if there
+ * is none, or its tick in interval.
+ */
+bool shared_attach(int *interval)
+{
+	void *map;
+	int fd;
+
+	if ((fd = shm_open(SHM_NAME, O_RDONLY, 0)) == -1) return false;
+	if (!trusted(fd)) {
+		close(fd);
+		return false;
+	}
+	map = mmap(0, SHM_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return false;
+	head = map;
+	if (memcmp(head->magic, SHM_MAGIC, sizeof SHM_MAGIC) ||
+	    !alive(head->pid) ||
+	    !__atomic_load_n(&head->gen, __ATOMIC_ACQUIRE)) {
+		munmap(map, SHM_SIZE);
+		head = 0;
+		return false;
+	}
+	*interval = head->interval;
+	copy = xmalloc(SHM_SLOT);
+	tree_source(replay_procs, replay_cmdline);
+	return true;
+}
+
+/*
+ * Take the newest snapshot if there is one that has not been read.
+ */
+static bool take(void)
+{
+	unsigned long long gen, seq, len;
+	struct shm_slot *s;
+	int i;
+
+	for (i = 0; i < READ_TRIES; i++) {
+		gen = __atomic_load_n(&head->gen, __ATOMIC_ACQUIRE);
+		if (gen == seen) return false;
+		s = &head->slot[gen & 1];
+		seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		len = s->len;
+		if (seq & 1 || len > SHM_SLOT) continue;
+		memcpy(copy, slot_data(gen & 1), len);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+		seen = gen;
+		replay_load(copy, len);
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Called every tick. When whowatchd has gone away the viewer goes
+ * back to reading the system itself.
+ */
+void shared_tick(void)
+{
+	if (!head) return;
+	if (take()) {
+		users_sync(replay_users);
+		return;
+	}
+	if (alive(head->pid)) return;
+	munmap(head, SHM_SIZE);
+	head = 0;
+	free(copy);
+	tree_source(for_each_pinfo, cmdline_lookup);
+	users_live();
+}
@@ -73,8 +73,6 @@ assert(main_pad != NULL);
 			sub_current->offset--;
 		break;
 	case 'y':
-		dolog("%s: sending %d signal to %d\n",
-			__FUNCTION__, signals[sub_current->arrow].sig, cur_pid);
 		do_signal(signals[sub_current->arrow].sig, cur_pid);
 		return KEY_HANDLED;
 	default: return KEY_SKIPPED;
@@ -123,7 +121,7 @@ static void signal_list(void *p)
 	int size = sizeof signals/sizeof (struct signal_t);
 	char buf[16];
 	int i, pid = *(int *) p;
-	dolog("%s: pid %d\n", __FUNCTION__, pid);
+	trace_event(TR_SIGNAL_LIST, pid, 0, 0);
 	if(pid <= 0) {
 		title("No valid pid selected");
 		return;
@@ -215,9 +213,13 @@ static void *on_cursor(void)
 {
 	static void *p = NULL;
 	static int pid;
+	struct user_t *u;
 	if(current == &users_list)
 		p = cursor_user()->name;
-	else {
+	else if(current == &history_win) {
+		u = history_user();
+		p = u ? u->name : "";
+	} else {
 		pid = cursor_pid();
 		p = &pid;
 	}
@@ -233,7 +235,6 @@ void pad_draw(void)
 {
 	void *p;
 assert(sub_current);
-	dolog("%s: entering\n", __FUNCTION__);	
 	if(!main_pad->wd) return;
 	werase(main_pad->wd);
 	sub_current->lines = 0; 
@@ -241,7 +242,7 @@ assert(sub_current);
 	if(sub_current == &sub_info) {
 		draw_plugin(0);
 //		pad_refresh();
-		dolog("%s; info only..skipping draw\n", __FUNCTION__);
+		trace_event(TR_PAD_DRAW, sub_current->lines, -1, 0);
 		return;
 	}
 	p = on_cursor();
@@ -257,12 +258,12 @@ assert(sub_current);
 		draw_plugin(p);
 	}		
 	else {
-		dolog("%s; only builtin draw\n", __FUNCTION__);
 		sub_current->builtin_draw(p);
 	}	
 	/* number of data lines probably has changed - adjust offset */
 	if(sub_current->offset + main_pad->size_y - PAD_Y > sub_current->lines) 
 		sub_current->offset = sub_current->lines - (main_pad->size_y - PAD_Y);
+	trace_event(TR_PAD_DRAW, sub_current->lines, sub_current->flags, 0);
 }
 
 /* 
@@ -331,7 +332,6 @@ AGAIN:
 		snprintf(dlerr, sizeof dlerr, "%s", dlerror());
 		return dlerr;
 	}
-	dolog("%s: dlopen returned %x\n", __FUNCTION__, h);
 	/* 
 	 * Check if the same plugin has been loaded. 
 	 * Plugin's name could be the same but code could be different.
@@ -340,12 +340,8 @@ AGAIN:
 	 */
 	for(i = 0; i < sizeof sb/sizeof(struct subwin *); i++) {
 		if(sb[i]->handle == h) {
-			dolog("%s: subwin %d has handle %x\n",
-				__FUNCTION__, i, sb[i]->handle); 		
 			dlclose(h);
 			dlclose(sb[i]->handle);
-			dolog("%s: plugin already loaded in subwin %d, count %d\n",
-				__FUNCTION__, i, i);
 			sb[i]->handle = h = 0;
 			goto AGAIN;
 		break;
@@ -366,18 +362,13 @@ AGAIN:
 	target->plugin_clear = dlsym(h, "plugin_clear");
 	target->plugin_cleanup = dlsym(h, "plugin_cleanup");
 	/* close previous library if it was loaded */
-	if(target->handle) {
-		int i;
-		i = dlclose(target->handle);
-		dolog("%s: closing prev library: %d %s\n",
-			__FUNCTION__, i, dlerror());
-	}
-	dolog("%s: plugin loaded\n", __FUNCTION__);
+	if(target->handle) dlclose(target->handle);
+	trace_event(TR_PLUGIN, 1, *type, 0);
 	target->handle = h;
 	target->flags = target->plugin_init(on_cursor());
 	return 0;
 ERROR:
-	dolog("%s: plugin not loaded\n", __FUNCTION__);
+	trace_event(TR_PLUGIN, 0, type ? *type : -1, 0);
 	snprintf(dlerr, sizeof dlerr, "%s", err);
 	dlclose(h);
 	return dlerr;
@@ -402,7 +393,7 @@ static inline void builtin_set(void)
 void sub_switch(void)
 {
   if (sub_current == &sub_info || sub_current == &sub_main) return;
-  if (current == &users_list) {
+  if (current == &users_list || current == &history_win) {
     if ((sub_current == &sub_signal) && main_pad->wd) {
       pad_destroy();
     }
@@ -435,8 +426,6 @@ void subwin_init(void)
 	sub_current = &sub_user;
 	/* set builtin plugins */
 	builtin_set();
-	dolog("%s: %d %d\n", __FUNCTION__, sub_main.arrow, sub_proc.arrow);
-	
 }
 
 bool sub_keys(int key)
@@ -444,14 +433,14 @@ bool sub_keys(int key)
 	if(keys_inside(key)) return KEY_HANDLED;
 	switch(key) {
 	case 'd': 
-		if(current == &users_list) {
+		if(current == &users_list || current == &history_win) {
 			 sub_current = &sub_user;
 			 break;
 		}
 		sub_current = &sub_proc;
 		break;
 	case 'l':
-		if(current == &users_list) return KEY_HANDLED;
+		if(current != &proc_win) return KEY_HANDLED;
 		sub_current = &sub_signal;
 		break;	
 	case 's':
@@ -465,11 +454,8 @@ bool sub_keys(int key)
 		}	
 	default: return KEY_SKIPPED;
 	}
-	dolog("%s: key processed\n", __FUNCTION__);	
-	dolog("%s: cur %d, %d %d\n", __FUNCTION__, sub_current->arrow, sub_main.arrow, sub_proc.arrow);
-
+	trace_event(TR_SUB_KEY, key, sub_current->arrow, 0);
 	sub_change(sub_current);
-	dolog("%s: cur %d, %d %d\n", __FUNCTION__, sub_current->arrow, sub_main.arrow, sub_proc.arrow);
 
 	return KEY_HANDLED;
 }
@@ -477,12 +463,12 @@ bool sub_keys(int key)
 void sub_periodic(void)
 {
 	if(!main_pad->wd) return;
+	prof_begin(PROF_SUB);
 	if(sub_current->flags & PERIODIC) {
-	dolog("%s: doing plugin (and perhaps builtin) draw\n", __FUNCTION__);
 		pad_draw();
 	}
-	dolog("%s: doing refresh\n", __FUNCTION__);
 	pad_refresh();
+	prof_end(PROF_SUB);
 }
 
 /*
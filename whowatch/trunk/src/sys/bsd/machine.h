@@ -14,11 +14,16 @@ extern bool can_use_kvm;
 extern kvm_t *kd;
 #endif
 
-struct pinfo {
-	int pid;
-	int ppid;
-};
+struct pinfo;
 
 void machine_init ();
+bool set_scanner (const char *name);
 int get_login_pid (const char *tty);
 void for_each_pinfo (void (*func) (struct pinfo *info, void *data),void *data);
+bool get_pinfo (int pid, struct pinfo *i);
+int proc_events_open (void);
+int proc_events_read (void (*func) (int what, int pid, void *data), void *data);
+
+#define PEV_FORK	1
+#define PEV_EXEC	2
+#define PEV_EXIT	3
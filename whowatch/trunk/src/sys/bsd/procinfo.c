@@ -164,6 +164,45 @@ char *get_cmdline(int pid)
 #endif
 }
 	 
+/*
+ * Copy the command line of the process into buf.
+ */
+int read_cmdline(int pid, char *buf, int size)
+{
+	struct kinfo_proc info;
+
+	if(fill_kinfo(&info, pid) == -1)
+		return -1;
+	snprintf(buf, size, "%s", get_cmdline(pid));
+	return strlen(buf);
+}
+
+/*
+ * Command lines are taken from sysctl/kvm directly, there is no cache.
+ */
+char *cmdline_lookup(struct pinfo *i)
+{
+	if(!full_cmd) return i->comm;
+	return get_cmdline(i->pid);
+}
+
+void cmdline_forget(int pid)
+{
+}
+
+/*
+ * The owner is read with the rest of the snapshot every time.
+ */
+void owner_forget(int pid)
+{
+}
+
+void cmdline_stats(unsigned long *hits, unsigned long *misses,
+		   unsigned int *entries)
+{
+	*hits = *misses = *entries = 0;
+}
+
 /* 
  * Get process group ID of the process which currently owns the tty
  * that the process is connected to and return its command line.
@@ -187,23 +226,6 @@ char *get_name(int pid)
 }
 
 
-/*
- * Get state and owner (effective uid) of a process
- */
-void get_state(struct process *p)
-{
-	struct procinfo pi;
-	/* state SSLEEP won't be marked in proc tree */
-	char s[] = "FR DZ";
-	get_info(p->proc->pid, &pi);
-	p->uid = pi.euid;
-	if(pi.stat == ' ') {
-		p->state = '?';
-		return;
-	}
-	p->state = s[pi.stat-1];
-}
-
 /* 
  * It really shouldn't be in this file.
  * Count idle time.
@@ -218,23 +240,19 @@ char *count_idle (const char *tty)
 	
 	if(stat(buf,&st) == -1) return "?";
 	idle_time = time(0) - st.st_atime;	
-	
-	if (idle_time >= 3600 * 24) 
-		sprintf(buf,"%ldd", (long) idle_time/(3600 * 24) );
-	else if (idle_time >= 3600){
-		time_t min = (idle_time % 3600) / 60;
-		sprintf(buf,"%ld:%02ld", (long)idle_time/3600, (long) min);
-	}
-	else if (idle_time >= 60)
-		sprintf(buf,"%ld", (long) idle_time/60);
-	else
-		sprintf(buf," ");
-	
-	return buf;
+	return format_idle(idle_time, buf, sizeof buf);
 }
 
 
 
+/*
+ * Processes are always read with sysctl().
+ */
+bool set_scanner (const char *name)
+{
+  return !strcmp (name, "sysctl");
+}
+
 static int get_all_info (struct kinfo_proc **info)
 {
 	int mib[3] = { CTL_KERN, KERN_PROC, KERN_PROC_ALL };
@@ -249,6 +267,21 @@ static int get_all_info (struct kinfo_proc **info)
 	return el;
 }
 
+static void kinfo_to_pinfo (struct kinfo_proc *pi, struct pinfo *p)
+{
+  p->pid = pi->ki_pid;
+  p->ppid = pi->ki_ppid;
+  p->tpgid = pi->ki_tpgid;
+  p->euid = pi->ki_uid;
+  /* state SSLEEP won't be marked in proc tree */
+  p->state = (pi->ki_stat > 0 && pi->ki_stat <= 5) ?
+      "FR DZ"[pi->ki_stat - 1] : '?';
+  p->start_time = pi->ki_start.tv_sec;
+  p->rss = pi->ki_rssize * (getpagesize() / 1024);
+  strncpy(p->comm, pi->ki_comm, sizeof p->comm - 1);
+  p->comm[sizeof p->comm - 1] = '\0';
+}
+
 void for_each_pinfo (void (*func) (struct pinfo *info, void *data), void *data)
 {
   struct kinfo_proc *pi;
@@ -260,10 +293,32 @@ void for_each_pinfo (void (*func) (struct pinfo *info, void *data), void *data)
   for (i = 0; i < el; i++) {
     struct pinfo p;
 
-    p.pid = pi[i].ki_pid;
-    p.ppid = pi[i].ki_ppid;
+    kinfo_to_pinfo (&pi[i], &p);
     (*func) (&p, data);
   }
 
   free (pi);
 }
+
+bool get_pinfo (int pid, struct pinfo *i)
+{
+  struct kinfo_proc info;
+
+  if (fill_kinfo (&info, pid) == -1)
+    return false;
+  kinfo_to_pinfo (&info, i);
+  return true;
+}
+
+/*
+ * There is no proc connector here, the tree is updated by scanning.
+ */
+int proc_events_open (void)
+{
+  return -1;
+}
+
+int proc_events_read (void (*func) (int what, int pid, void *data), void *data)
+{
+  return 0;
+}
@@ -1,8 +1,47 @@
-struct pinfo {
-	int pid;
-	int ppid;
+#include <stdbool.h>
+
+struct pinfo;
+
+#define STAT_SIZE	1024		/* enough for /proc/<pid>/stat	*/
+
+/*
+ * Counters of the /proc scanner.
+ */
+struct scan_stats {
+	const char *backend;		/* "plain" or "uring"		*/
+	unsigned long scans;		/* walks through /proc		*/
+	unsigned long procs;		/* processes read		*/
+	unsigned long syscalls;		/* system calls made		*/
+	unsigned long long bytes;	/* bytes read			*/
+	unsigned long long last_usec;	/* duration of the last scan	*/
+	unsigned long long total_usec;	/* duration of all scans	*/
 };
 
+/* uring.c */
+#define URING_BATCH	256
+
+struct uring_req {
+	char name[16];			/* <pid>			*/
+	char path[24];			/* <pid>/stat			*/
+	char buf[STAT_SIZE];
+	int len;			/* bytes read or -1		*/
+	int euid;
+};
+
+int uring_init(int dirfd);
+int uring_read(struct uring_req *r, int n, unsigned long *syscalls);
+
+/* proc_events.c */
+#define PEV_FORK	1
+#define PEV_EXEC	2
+#define PEV_EXIT	3
+
+int proc_events_open(void);
+int proc_events_read(void (*func)(int what, int pid, void *data), void *data);
+
 /* Linux */
 void machine_init ();
+bool set_scanner (const char *name);
 void for_each_pinfo (void (*func) (struct pinfo *info, void *data),void *data);
+void get_scan_stats (struct scan_stats *s);
+bool get_pinfo (int pid, struct pinfo *i);
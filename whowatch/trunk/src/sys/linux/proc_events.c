@@ -0,0 +1,119 @@
+/*
+ * Process events (fork, exec, exit) from the kernel proc connector.
+ * Subscribing needs CAP_NET_ADMIN, without it the tree is updated
+ * only by scanning /proc.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+#include "machine.h"
+
+#define EVENTS_RCVBUF	(1024 * 1024)
+
+static int nl_fd = -1;
+
+/*
+ * Open the netlink socket and ask for process events.
+ * Returns the descriptor to wait on or -1.
+ */
+int proc_events_open(void)
+{
+	struct sockaddr_nl addr;
+	struct __attribute__ ((packed)) {
+		struct nlmsghdr nl;
+		struct cn_msg cn;
+		enum proc_cn_mcast_op op;
+	} msg;
+	int size = EVENTS_RCVBUF;
+
+	if (nl_fd != -1) return nl_fd;
+	nl_fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+	if (nl_fd == -1) return -1;
+	setsockopt(nl_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+
+	memset(&addr, 0, sizeof addr);
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = CN_IDX_PROC;
+	if (bind(nl_fd, (struct sockaddr *) &addr, sizeof addr) == -1)
+		goto fail;
+
+	memset(&msg, 0, sizeof msg);
+	msg.nl.nlmsg_len = sizeof msg;
+	msg.nl.nlmsg_type = NLMSG_DONE;
+	msg.cn.id.idx = CN_IDX_PROC;
+	msg.cn.id.val = CN_VAL_PROC;
+	msg.cn.len = sizeof msg.op;
+	msg.op = PROC_CN_MCAST_LISTEN;
+	if (send(nl_fd, &msg, sizeof msg, 0) == -1)
+		goto fail;
+	return nl_fd;
+fail:
+	close(nl_fd);
+	nl_fd = -1;
+	return -1;
+}
+
+/*
+ * Pass all queued events to func. Events of threads are skipped.
+ * Returns the number of events or -1 if the socket buffer overflowed
+ * and some of them were lost.
+ */
+int proc_events_read(void (*func)(int what, int pid, void *data), void *data)
+{
+	char buf[8192] __attribute__ ((aligned (NLMSG_ALIGNTO)));
+	struct nlmsghdr *h;
+	struct cn_msg *cn;
+	struct proc_event *ev;
+	int n, count = 0;
+	bool lost = false;
+
+	if (nl_fd == -1) return 0;
+	for (;;) {
+		n = recv(nl_fd, buf, sizeof buf, MSG_DONTWAIT);
+		if (n == -1) {
+			if (errno == EINTR) continue;
+			if (errno == ENOBUFS) {
+				lost = true;
+				continue;
+			}
+			break;
+		}
+		for (h = (struct nlmsghdr *) buf; NLMSG_OK(h, n);
+		     h = NLMSG_NEXT(h, n)) {
+			cn = NLMSG_DATA(h);
+			if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC)
+				continue;
+			ev = (struct proc_event *) cn->data;
+			switch (ev->what) {
+			case PROC_EVENT_FORK:
+				if (ev->event_data.fork.child_pid !=
+				    ev->event_data.fork.child_tgid)
+					continue;
+				func(PEV_FORK, ev->event_data.fork.child_tgid, data);
+				break;
+			case PROC_EVENT_EXEC:
+				func(PEV_EXEC, ev->event_data.exec.process_tgid, data);
+				break;
+			case PROC_EVENT_EXIT:
+				if (ev->event_data.exit.process_pid !=
+				    ev->event_data.exit.process_tgid)
+					continue;
+				func(PEV_EXIT, ev->event_data.exit.process_tgid, data);
+				break;
+			default:
+				continue;
+			}
+			count++;
+		}
+	}
+	return lost ? -1 : count;
+}
@@ -8,6 +8,9 @@
 
 #include "config.h"
 
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <strings.h>
 #include <unistd.h>
 #include <string.h>
@@ -15,12 +18,30 @@
 
 #include "pluglib.h"
 #include "whowatch.h"
+#include "proctree.h"
+#include "pool.h"
 #include "machine.h"
 
 #define EXEC_FILE	128
 #define elemof(x)	(sizeof (x) / sizeof*(x))
 #define endof(x)	((x) + elemof(x))
 
+/*
+ * Path of a file under the proc root, valid until the next call.
+ */
+static char *proc_path(const char *fmt, ...)
+{
+	static char path[PATH_MAX];
+	va_list ap;
+	int n;
+
+	n = snprintf(path, sizeof path, "%s/", proc_dir);
+	va_start(ap, fmt);
+	vsnprintf(path + n, sizeof path - n, fmt, ap);
+	va_end(ap);
+	return path;
+}
+
 static inline void no_info(void)
 {
 	println("Information unavailable.");
@@ -38,9 +59,7 @@ static inline char *_read_link(const char *path)
 static void read_link(int pid, char *name)
 {
 	char *v;
-	char pbuf[32];
-	snprintf(pbuf, sizeof pbuf, "/proc/%d/%s", pid, name); 
-	v = _read_link(pbuf);
+	v = _read_link(proc_path("%d/%s", pid, name));
 	if(!v) {
 		no_info();
 		return;
@@ -104,7 +123,6 @@ static void hash_init(struct list_head *hash)
 
 static inline void add_to_hash(struct netconn_t *c, int inode)
 {
-	// dolog("%s: inode %d, %s\n", __FUNCTION__,inode, ip_addr(c));
 	list_add(&c->n_hash, tcp_hashtable + hash(inode));
 }		
 
@@ -113,15 +131,12 @@ static struct netconn_t *tcp_find(unsigned int inode, struct list_head *head)
 	struct list_head *h, *tmp;
 	struct netconn_t *t;
 	tmp  = head + hash(inode);
-	// dolog("%s: looking for %d (hash %d)\n", __FUNCTION__, inode, hash(inode));
 	list_for_each(h, tmp) {
 		t = list_entry(h, struct netconn_t, n_hash);
 		if(inode == t->inode) {
-	// dolog("%s: found [%d]\n", __FUNCTION__, t->inode);		
 			return t;
 }			
 	}
-	// dolog("%s: [%d] not found\n", __FUNCTION__, inode);	
 	return 0;
 }
 
@@ -135,7 +150,7 @@ static struct netconn_t *new_netconn(unsigned int inode, struct netconn_t *src)
 	t->inode = inode;
 	add_to_hash(t, inode);
 	list_add(&t->n_list, &tcp_l);
-	dolog("%s: new conn [%d]\n", __FUNCTION__, inode);	
+	trace_event(TR_CONN, inode, t->state, 1);
 	return t;
 }
 
@@ -147,22 +162,17 @@ bzero(&t, sizeof(t));
 	i = sscanf(s, "%x:%x %x:%x %x", &t.s_addr, &t.s_port, 
 			&t.d_addr, &t.d_port, &t.state);
 	if(i != 5) return 0;
-	// dolog("%s: entering\n", __FUNCTION__);	
 	tmp = tcp_find(inode, tcp_hashtable);
 	if(!tmp) {
-	// dolog("%s: %d %d %d not found\n", __FUNCTION__, inode, t.s_port, t.d_port);
 
 		tmp =  new_netconn(inode, &t);		
 		return tmp;
 	}	
 //	t.used = tmp->used = 0;
 	if(!memcmp((char*)&t + offset,(char*)tmp + offset, sizeof(t) - offset)) {
-		dolog("%s: %d %d %d %s found, not changed\n",
-			__FUNCTION__, inode, t.s_port, t.d_port, tcp_state[t.state-1]);	
 		return tmp; 
 	}
-	dolog("%s: %d %d->%d %d->%d found,changed\n",
-		__FUNCTION__, inode, t.s_port, t.d_port, tmp->s_port, tmp->d_port);	
+	trace_event(TR_CONN, inode, t.state, 0);
 	memcpy((char*)&t + offset, (char*)tmp + offset, sizeof(t) - offset);
 /*
 	tmp->s_addr = t.s_addr;	
@@ -190,9 +200,8 @@ static void read_tcp_conn(void)
     flag = 1;
   }	
 
-  // dolog("%s: reading tcp connections\n", __FUNCTION__);
 
-  if (!(f = fopen("/proc/net/tcp", "r"))) return;
+  if (!(f = fopen(proc_path("net/tcp"), "r"))) return;
 
   /* skip titles */
   if (!fgets (buf, sizeof buf, f))
@@ -210,7 +219,6 @@ static void read_tcp_conn(void)
 
   fclose(f);
 
-  // dolog("%s: done.\n", __FUNCTION__);	
 }
 
 /*
@@ -236,13 +244,10 @@ static int show_net_conn(char *s)
 	struct netconn_t *t;
 	unsigned int inode = 0;	
 	if(sscanf(s, "%d", &inode) != 1) return 1;
-	// dolog("%s: looking for [%d]\n", __FUNCTION__, inode);	
 	t = tcp_find(inode, tcp_hashtable);
 	if(!t) {
-	// dolog("%s: %d not found\n", __FUNCTION__, inode);	
 		return 0;
 	}
-	// dolog("%s: %d found, printing\n", __FUNCTION__, inode);		
 	print_net_conn(t);
 	return 1;
 }
@@ -252,7 +257,6 @@ static void del_conn(void)
 {
 	struct list_head *h;
 	struct netconn_t *t;
-	// dolog("%s: looking for %d (hash %d)\n", __FUNCTION__, inode, hash(inode));
 	list_for_each(h, &tcp_l) {
 		t = list_entry(h, struct netconn_t, n_list);
 		if(t->valid	
@@ -269,18 +273,15 @@ void open_fds(int pid, char *name)
 {
 	DIR *d;
 	char *s;
-	char buf[32];
 	struct dirent *dn;
 	static long long count = 0;
-	snprintf(buf, sizeof buf, "/proc/%d/fd", pid);
-	d = opendir(buf);
+	d = opendir(proc_path("%d/fd", pid));
 	if(!d) {
 		no_info();
 		return;
 	}
 	if(!count || ticks - count >= 2) {
 	// write(1, "\a", 1);	
-	// dolog("%s reading tcp conn %d %d\n", __FUNCTION__, ticks, ticks%2);	
 	read_tcp_conn();
 	count = ticks;
 
@@ -288,8 +289,7 @@ void open_fds(int pid, char *name)
 	while((dn = readdir(d))) {
 		if(dn->d_name[0] == '.') continue;
 		print("%s - ", dn->d_name);
-		snprintf(buf, sizeof buf, "/proc/%d/fd/%s", pid, dn->d_name);
-		s = _read_link(buf);
+		s = _read_link(proc_path("%d/fd/%s", pid, dn->d_name));
 		if(!s) no_info();
 		else {
 			if(!strncmp("socket:[", s, 8) && show_net_conn(s+8));
@@ -358,9 +358,7 @@ END:
 
 static void read_meminfo(int pid, char *name)
 {
-	char buf[32];
-	snprintf(buf, sizeof buf, "/proc/%d/status", pid);
-	read_proc_file(buf, "Uid", "VmLib");
+	read_proc_file(proc_path("%d/status", pid), "Uid", "VmLib");
 }
 
 #define START_TIME_POS	21
@@ -371,12 +369,10 @@ static void read_meminfo(int pid, char *name)
  */
 static unsigned long p_start_time(int pid)
 {
-	char buf[32];
 	FILE *f;
 	int i;
 	unsigned long  c = 0;
-	snprintf(buf, sizeof buf, "/proc/%d/stat", pid);
-	f = fopen(buf, "r");
+	f = fopen(proc_path("%d/stat", pid), "r");
 	if(!f) return -1;
 	while((i = fgetc(f)) != EOF) {
 		if(i == ' ') c++;
@@ -399,8 +395,7 @@ void get_boot_time(void)
 	FILE *f;
 	unsigned long c;
 	int i = 0;
-	snprintf(buf, sizeof buf, "/proc/stat");
-	f = fopen(buf, "r");
+	f = fopen(proc_path("stat"), "r");
 	if(!f) return;
 	while(fgets(buf, sizeof buf, f)) {
 		if(i == ' ') c++;
@@ -421,7 +416,8 @@ static void proc_starttime(int pid, char *name)
 {
 	unsigned long i, sec;
 	char *s;
-	i = p_start_time(pid);
+	struct pinfo *info = tree_pinfo(pid);
+	i = info ? info->start_time : p_start_time(pid);
 	if(i == -1 || !boot_time) {
 		no_info();
 		return;
@@ -486,8 +482,7 @@ static int fill_cpu_info(void)
 	FILE *f;
 	struct cpu_info_t *tmp;
 	int i = 0;
-	snprintf(buf, sizeof buf, "/proc/stat");
-	f = fopen(buf, "r");
+	f = fopen(proc_path("stat"), "r");
 	if(!f) return -1;
 	while(fgets(buf, sizeof buf, f)) 
 		if(!strncmp(buf, "cpu  ", 5)) goto FOUND;
@@ -533,6 +528,34 @@ static void get_cpu_info()
 	print("%s", buf);
 }
 
+static void print_cmdline_cache(void)
+{
+	unsigned long hits, misses;
+	unsigned int entries;
+	cmdline_stats(&hits, &misses, &entries);
+	println("%u entries, %lu hits, %lu misses", entries, hits, misses);
+}
+
+static void print_scan_stats(void)
+{
+	struct scan_stats st;
+	get_scan_stats(&st);
+	if(!st.procs) {
+		no_info();
+		return;
+	}
+	println("%s, %.2f ms per scan (last %.2f ms)", st.backend,
+		st.total_usec / 1000.0 / st.scans, st.last_usec / 1000.0);
+	println("  %lu scans, %.1f syscalls per process", st.scans,
+		(double) st.syscalls / st.procs);
+}
+
+static void print_pool(struct pool *p, void *unused)
+{
+	println("  %s: %lu live, %lu free, %lu chunks", p->name, p->live,
+		p->nfree, p->nchunks);
+}
+
 void builtin_sys_draw(void *unused)
 {
 	int c;
@@ -540,30 +563,36 @@ void builtin_sys_draw(void *unused)
 	print_boot_time();
 	print("CPU: ");
 	get_cpu_info();
+	print("CMDLINE CACHE: ");
+	print_cmdline_cache();
+	print("PROC SCAN: ");
+	print_scan_stats();
+	println("NODE POOLS:");
+	pool_for_each(print_pool, 0);
 	println("MEMORY:");
-	read_proc_file("/proc/meminfo", "MemTotal:", 0);
+	read_proc_file(proc_path("meminfo"), "MemTotal:", 0);
 	title("USED FILES: ");
-	c = read_file_pos("/proc/sys/fs/file-nr", 2);
+	c = read_file_pos(proc_path("sys/fs/file-nr"), 2);
 	if(c == -1) no_info();
 	else println("%d", c);
 	print("USED INODES: ");
-	c = read_file_pos("/proc/sys/fs/inode-nr", 2);
+	c = read_file_pos(proc_path("sys/fs/inode-nr"), 2);
 	if(c == -1) no_info();
 	else println("%d", c);
 	
 	print("MAX FILES: ");
-	read_proc_file("/proc/sys/fs/file-max", 0, 0);
+	read_proc_file(proc_path("sys/fs/file-max"), 0, 0);
 	print("MAX INODES: ");
-	read_proc_file("/proc/sys/fs/inode-max", 0, 0);
+	read_proc_file(proc_path("sys/fs/inode-max"), 0, 0);
 	println("\nSTAT:");
-	read_proc_file("/proc/stat", "cpu", "intr");
+	read_proc_file(proc_path("stat"), "cpu", "intr");
 	println("\nLOADED MODULES:");
-	read_proc_file("/proc/modules", 0, 0);
+	read_proc_file(proc_path("modules"), 0, 0);
 	println("\nFILESYSTEMS:");
-	read_proc_file("/proc/filesystems", 0, 0);
+	read_proc_file(proc_path("filesystems"), 0, 0);
 	println("\nPARTITIONS:");
-	read_proc_file("/proc/partitions", 0, 0);
+	read_proc_file(proc_path("partitions"), 0, 0);
 	println("\nDEVICES:");
-	read_proc_file("/proc/devices", 0, 0);
+	read_proc_file(proc_path("devices"), 0, 0);
 }	
 
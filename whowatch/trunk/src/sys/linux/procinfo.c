@@ -8,11 +8,13 @@
 #include "config.h"
 
 #include <ctype.h>
-#include <dirent.h>
 #include <err.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -26,8 +28,6 @@
 #define elemof(x)	(sizeof (x) / sizeof*(x))
 #define endof(x)	((x) + elemof(x))
 
-#define PROCDIR "/proc"
-
 struct procinfo
 {
 	int ppid;			/* parent pid		*/
@@ -43,7 +43,7 @@ struct procinfo
  */
 void get_info(int pid, struct procinfo *p)
 {
-    	char buf[32];
+    	char buf[PATH_MAX];
     	FILE *f;
 
 	p->ppid = -1;
@@ -56,7 +56,7 @@ void get_info(int pid, struct procinfo *p)
 	p->stat = ' ';
 	p->tpgid = -1;
 	strcpy(p->exec_file, "can't access");
-    	snprintf(buf, sizeof buf, "/proc/%d/stat", pid);
+    	snprintf(buf, sizeof buf, "%s/%d/stat", proc_dir, pid);
     	if (!(f = fopen(buf,"rt"))) 
     		return;
     	if(fscanf(f,"%*d %128s %*c %d %*d %*d %*d %d",
@@ -79,40 +79,373 @@ int get_ppid(int pid)
 }
 
 
+/*
+ * /proc is kept open between scans. Processes are found with large
+ * getdents64() batches and their stat files are opened relative to
+ * the directory, so the kernel doesn't walk "/proc" for every one.
+ */
+#define DENTS_SIZE	(64 * 1024)
+
+struct linux_dirent64 {
+	uint64_t	d_ino;
+	int64_t		d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[];
+};
+
+static int proc_fd = -1;
+static char *dents;
+static char stat_buf[STAT_SIZE];
+static struct scan_stats stats = { "plain" };
+static struct uring_req *batch;		/* NULL unless io_uring is used */
+
+static void open_procdir(void)
+{
+	if (proc_fd != -1) return;
+	proc_fd = open(proc_dir, O_RDONLY | O_DIRECTORY);
+	if (proc_fd == -1)
+		err(EXIT_FAILURE, "cannot open %s", proc_dir);
+	dents = xmalloc(DENTS_SIZE);
+}
+
+/*
+ * Returns pointer to the n-th field after s.
+ */
+static inline char *next_field(char *s, int n)
+{
+	while (n-- && s)
+		if ((s = strchr(s, ' '))) s++;
+	return s;
+}
+
+/*
+ * Fill the snapshot from the contents of /proc/<pid>/stat.
+ * Name of the executable is the only field that may contain
+ * spaces, so the rest is parsed from the last ')'.
+ */
+static bool parse_stat(char *buf, struct pinfo *i)
+{
+	static unsigned long page_kb;
+	char *s, *e;
+	int n;
+
+	i->pid = atoi(buf);
+	s = strchr(buf, '(');
+	e = strrchr(buf, ')');
+	if (i->pid <= 0 || !s || !e || e < s || !e[1]) return false;
+	n = e - s - 1;
+	if (n >= sizeof i->comm) n = sizeof i->comm - 1;
+	memcpy(i->comm, s + 1, n);
+	i->comm[n] = '\0';
+
+	s = e + 2;			/* state	*/
+	i->state = *s;
+	if (!(s = next_field(s, 1)))	/* ppid		*/
+		return false;
+	i->ppid = atoi(s);
+	if (!(s = next_field(s, 4)))	/* tpgid	*/
+		return false;
+	i->tpgid = atoi(s);
+	if (!(s = next_field(s, 14)))	/* start time	*/
+		return false;
+	i->start_time = strtoull(s, 0, 10);
+	if (!(s = next_field(s, 2)))	/* rss, in pages */
+		return false;
+	if (!page_kb) page_kb = sysconf(_SC_PAGESIZE) / 1024;
+	i->rss = strtoul(s, 0, 10) * page_kb;
+	return true;
+}
+
+/*
+ * Owners of processes. /proc/<pid> belongs to the effective uid of
+ * the process, but a stat of it every scan would be a fourth system
+ * call per process. A process keeps its uid unless it calls
+ * setuid(), which daemons do right after fork, or execs a setuid
+ * program like sudo, which changes its name. So the uid is taken
+ * again when the name changes, on the scan after a process is first
+ * seen and then every OWNER_RECHECK scans. The table is indexed by
+ * pid, a collision only costs a stat, and it is made larger when it
+ * gets half full.
+ */
+#define OWNER_MIN	1024
+#define OWNER_RECHECK	16
+
+struct owner
+{
+	int pid;
+	int euid;
+	unsigned long long start_time;
+	unsigned long scan;		/* stats.scans when it was taken */
+	char comm[COMM_SIZE];
+};
+
+static struct owner *owners;
+static unsigned int owner_mask;
+
+static void owners_size(unsigned long procs)
+{
+	unsigned int size = owner_mask + 1;
+
+	if (owners && 2 * procs <= size) return;
+	if (!owners) size = OWNER_MIN;
+	while (2 * procs > size) size *= 2;
+	free(owners);
+	owners = xcalloc(size, sizeof *owners);
+	owner_mask = size - 1;
+}
+
+static int proc_owner(const char *name, struct pinfo *i)
+{
+	struct owner *o;
+	struct stat st;
+	bool known;
+
+	owners_size(0);
+	o = &owners[i->pid & owner_mask];
+	known = o->pid == i->pid && o->start_time == i->start_time &&
+		!strcmp(o->comm, i->comm);
+	if (known && stats.scans - o->scan < OWNER_RECHECK)
+		return o->euid;
+	stats.syscalls++;
+	o->euid = fstatat(proc_fd, name, &st, 0) ? -1 : st.st_uid;
+	o->pid = i->pid;
+	o->start_time = i->start_time;
+	strcpy(o->comm, i->comm);
+	/* a new one is looked at again on the next scan */
+	o->scan = known ? stats.scans : stats.scans - OWNER_RECHECK + 1;
+	return o->euid;
+}
+
+/*
+ * The process has called exec(), its uid is taken again.
+ */
+void owner_forget(int pid)
+{
+	if (owners && owners[pid & owner_mask].pid == pid)
+		owners[pid & owner_mask].pid = 0;
+}
+
+/*
+ * Read the snapshot of a single process. Name is a pid as
+ * found in /proc.
+ */
+static bool stat_pinfo(const char *name, struct pinfo *i)
+{
+	char path[32];
+	int f, n, l;
+
+	l = strlen(name);
+	if (l > sizeof path - sizeof "/stat") return false;
+	memcpy(path, name, l);
+	memcpy(path + l, "/stat", sizeof "/stat");
+
+	stats.syscalls++;
+	if ((f = openat(proc_fd, path, O_RDONLY)) == -1)
+		return false;
+	stats.syscalls += 2;
+	n = read(f, stat_buf, sizeof stat_buf - 1);
+	close(f);
+	if (n <= 0) return false;
+	stats.bytes += n;
+	stat_buf[n] = '\0';
+	if (!parse_stat(stat_buf, i)) return false;
+	i->euid = proc_owner(name, i);
+	return true;
+}
+
+/*
+ * Read the snapshot of a single process.
+ */
+bool get_pinfo(int pid, struct pinfo *i)
+{
+	char name[16];
+
+	open_procdir();
+	snprintf(name, sizeof name, "%d", pid);
+	return stat_pinfo(name, i);
+}
+
+/*
+ * Read the command line of the process into buf with arguments
+ * separated by spaces. Returns its length, 0 if it is empty
+ * (kernel threads, zombies) or -1 if it can't be read.
+ * Only the first size - 1 bytes are needed, so one read() is enough.
+ */
+int read_cmdline(int pid, char *buf, int size)
+{
+	char name[32];
+	int f, i, n;
+
+	open_procdir();
+	snprintf(name, sizeof name, "%d/cmdline", pid);
+	if ((f = openat(proc_fd, name, O_RDONLY)) == -1)
+		return -1;
+	n = read(f, buf, size - 1);
+	close(f);
+	if (n < 0) return -1;
+	stats.bytes += n;
+	for (i = 0; i < n; i++)
+		if (buf[i] == '\0') buf[i] = ' ';
+	/* strip the separator after the last argument */
+	while (n > 0 && buf[n-1] == ' ') n--;
+	buf[n] = '\0';
+	return n;
+}
+
+/*
+ * Command lines almost never change after exec, so they are cached.
+ * An entry is valid as long as the pid, its start time and the name
+ * of the executable are the same - start time changes when the pid
+ * is reused and the name changes on exec. Entries that were not
+ * looked up for CMD_EXPIRE ticks are dropped.
+ */
+#define CMDLINE_SIZE	512
+#define CMD_HASH_MIN	256
+#define CMD_EXPIRE	20
+
+struct cmd_entry {
+	struct cmd_entry *next;
+	int pid;
+	unsigned long long start_time;
+	unsigned long long used;	/* tick of the last lookup	*/
+	char comm[COMM_SIZE];
+	char cmd[1];
+};
+
+static struct cmd_entry **cmd_hash;
+static unsigned int cmd_hash_size;
+static unsigned int cmd_count;
+static unsigned long long cmd_swept;
+static unsigned long cmd_hits, cmd_misses;
+
+static inline unsigned int cmd_hash_fun(int pid)
+{
+	return pid & (cmd_hash_size - 1);
+}
+
+static void cmd_rehash(unsigned int size)
+{
+	struct cmd_entry **old = cmd_hash, *e, *n;
+	unsigned int i, old_size = cmd_hash_size;
+
+	cmd_hash = xcalloc(size, sizeof *cmd_hash);
+	cmd_hash_size = size;
+	for (i = 0; i < old_size; i++)
+		for (e = old[i]; e; e = n) {
+			n = e->next;
+			e->next = cmd_hash[cmd_hash_fun(e->pid)];
+			cmd_hash[cmd_hash_fun(e->pid)] = e;
+		}
+	free(old);
+}
+
+static void cmd_sweep(void)
+{
+	struct cmd_entry **pp, *e;
+	unsigned int i;
+
+	if (ticks - cmd_swept < CMD_EXPIRE) return;
+	cmd_swept = ticks;
+	for (i = 0; i < cmd_hash_size; i++) {
+		pp = &cmd_hash[i];
+		while ((e = *pp)) {
+			if (e->used + CMD_EXPIRE >= ticks) {
+				pp = &e->next;
+				continue;
+			}
+			*pp = e->next;
+			free(e);
+			cmd_count--;
+		}
+	}
+}
+
+/*
+ * Return the command line of the process described by the snapshot.
+ * /proc/<pid>/cmdline is read only if the cached one is not valid.
+ */
+char *cmdline_lookup(struct pinfo *i)
+{
+	struct cmd_entry **pp, *e;
+	char buf[CMDLINE_SIZE];
+	int n;
+
+	if (!full_cmd) return i->comm;
+	if (!cmd_hash) cmd_rehash(CMD_HASH_MIN);
+	cmd_sweep();
+	for (pp = &cmd_hash[cmd_hash_fun(i->pid)]; (e = *pp); pp = &e->next)
+		if (e->pid == i->pid) break;
+	if (e && e->start_time == i->start_time && !strcmp(e->comm, i->comm)) {
+		e->used = ticks;
+		cmd_hits++;
+		return e->cmd;
+	}
+	cmd_misses++;
+	if (e) {
+		*pp = e->next;
+		free(e);
+		cmd_count--;
+	}
+	if ((n = read_cmdline(i->pid, buf, sizeof buf)) == -1)
+		return "-";
+	if (n == 0)
+		n = snprintf(buf, sizeof buf, "%s", i->comm);
+
+	e = xmalloc(sizeof *e + n);
+	e->pid = i->pid;
+	e->start_time = i->start_time;
+	e->used = ticks;
+	strcpy(e->comm, i->comm);
+	memcpy(e->cmd, buf, n + 1);
+	e->next = cmd_hash[cmd_hash_fun(e->pid)];
+	cmd_hash[cmd_hash_fun(e->pid)] = e;
+	if (++cmd_count > 2 * cmd_hash_size)
+		cmd_rehash(4 * cmd_hash_size);
+	return e->cmd;
+}
+
+/*
+ * Drop the cached command line of the process, it has called exec()
+ * and may have kept its name.
+ */
+void cmdline_forget(int pid)
+{
+	struct cmd_entry **pp, *e;
+
+	if (!cmd_hash) return;
+	for (pp = &cmd_hash[cmd_hash_fun(pid)]; (e = *pp); pp = &e->next)
+		if (e->pid == pid) {
+			*pp = e->next;
+			free(e);
+			cmd_count--;
+			return;
+		}
+}
+
+void cmdline_stats(unsigned long *hits, unsigned long *misses,
+		   unsigned int *entries)
+{
+	*hits = cmd_hits;
+	*misses = cmd_misses;
+	*entries = cmd_count;
+}
+
 /* 
  * Return the complete command line for the process
  */
 char *get_cmdline(int pid)
 {
-        static char buf[512];
-	struct procinfo p;
-	char *t;
-	int c;
-        FILE *f;
-        int i = 0;
-        if(!full_cmd) goto no_full;
-        memset(buf, 0, sizeof buf);
-        sprintf(buf, "/proc/%d/cmdline",pid);
-        if (!(f = fopen(buf, "rt")))
-                return "-";
-        while (fread(buf+i,1,1,f) == 1){
-	        if (buf[i] == '\0') buf[i] = ' ';
-                if (i == sizeof buf - 1) break;
-                i++;
-        }
-        fclose(f);
-	buf[i] = '\0';
-	if(!i) {
-no_full:
-		get_info(pid, &p);
-		t = p.exec_file;
-		bzero(buf, sizeof buf);
-		c = strlen(t);
-		if(p.exec_file[0] == '(') t++;
-		if(p.exec_file[--c] == ')') p.exec_file[c] = 0;
-		strncpy(buf, t, sizeof buf - 1);
-	}	
-        return buf;
+	static char comm[COMM_SIZE];
+	struct pinfo i;
+	char *s;
+
+	if (!get_pinfo(pid, &i))
+		return "-";
+	s = cmdline_lookup(&i);
+	if (s != i.comm) return s;
+	strcpy(comm, i.comm);
+	return comm;
 }
 	 
 /* 
@@ -137,35 +470,6 @@ char *get_name(int pid)
 }
 
 
-/*
- * Get state and owner (effective uid) of a process
- */
-void get_state(struct process *p)
-{
-  char buf[64];
-  struct stat s;
-  char state;
-  FILE *f;
-  
-  p->uid = -1;
-  snprintf(buf, sizeof buf - 6, "/proc/%d", p->proc->pid);
-  if (stat(buf, &s) >= 0) p->uid = s.st_uid;  
-
-  p->state = '?';
-  strcat(buf,"/stat");
-
-  if (!(f = fopen(buf,"rt")))
-    return;
-
-  if (fscanf(f,"%*d %*s %c", &state) != 1) {
-    fclose(f);
-    return;
-  }
-
-  fclose(f);
-  p->state = ((state == 'S') ? ' ' : state);
-}
-
 /* 
  * It really shouldn't be in this file.
  * Count idle time.
@@ -180,61 +484,129 @@ char *count_idle (const char *tty)
 	
 	if(stat(buf,&st) == -1) return "?";
 	idle_time = time(0) - st.st_atime;	
-	
-	if (idle_time >= 3600 * 24) 
-		sprintf(buf,"%ldd", (long) idle_time/(3600 * 24) );
-	else if (idle_time >= 3600){
-		time_t min = (idle_time % 3600) / 60;
-		sprintf(buf,"%ld:%02ld", (long)idle_time/3600, (long) min);
-	}
-	else if (idle_time >= 60)
-		sprintf(buf,"%ld", (long) idle_time/60);
-	else
-		sprintf(buf," ");
-	
-	return buf;
-}
-
-static bool get_pinfo (struct pinfo* i,DIR* d)
-{
-	static char name[32] = PROCDIR "/";
-	struct dirent* e;
-
-	for(;;) {
-		int f,n;
-		char buf[64],*p;
-
-		e=readdir(d);
-		if(!e) return false;
-		if(!isdigit(e->d_name[0])) continue;
-		sprintf(name+sizeof PROCDIR,"%s/stat",e->d_name);
-		f=open(name,0);
-		if (f == 0) continue;
-		n=read(f,buf,63);
-		close(f);
-		if(n<0) continue;
-		buf[n]=0;
-		p = strrchr(buf+4,')') + 4;
-		i->ppid = atoi(p);
-		i->pid = atoi(buf);
-		if(i->pid<=0) continue;
-		break;
-	}
-	return true;
+	return format_idle(idle_time, buf, sizeof buf);
+}
+
+/*
+ * Select how /proc is read: "plain" system calls for every process
+ * or "uring", which batches them. If io_uring can't be used the plain
+ * scanner stays selected. Returns false for an unknown name.
+ */
+bool set_scanner (const char *name)
+{
+  if (!strcmp (name, "plain")) {
+    free (batch);
+    batch = NULL;
+    stats.backend = "plain";
+    return true;
+  }
+  if (strcmp (name, "uring")) return false;
+  open_procdir ();
+  if (uring_init (proc_fd) == -1) {
+    warn ("io_uring unavailable, using plain scanner");
+    return true;
+  }
+  if (!batch) batch = xmalloc (URING_BATCH * sizeof *batch);
+  stats.backend = "uring";
+  return true;
+}
+
+static void flush_batch (int n, void (*func) (struct pinfo *, void *),
+			 void *data)
+{
+  struct pinfo info;
+  int i;
+
+  if (uring_read (batch, n, &stats.syscalls) == -1) {
+    /*
+     * The ring is broken, read the rest the usual way. Requests
+     * may still be in flight, so the buffers are never freed.
+     */
+    struct uring_req *r = batch;
+    batch = NULL;
+    stats.backend = "plain";
+    for (i = 0; i < n; i++)
+      if (stat_pinfo (r[i].name, &info)) {
+	stats.procs++;
+	(*func) (&info, data);
+      }
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    if (batch[i].len <= 0) continue;
+    stats.bytes += batch[i].len;
+    batch[i].buf[batch[i].len] = '\0';
+    if (!parse_stat (batch[i].buf, &info)) continue;
+    info.euid = batch[i].euid;
+    stats.procs++;
+    (*func) (&info, data);
+  }
+}
+
+/*
+ * Queue a process for the io_uring scanner.
+ */
+static int add_batch (int n, const char *name)
+{
+  struct uring_req *r = &batch[n];
+  int l = strlen (name);
+
+  if (l >= sizeof r->name) return n;
+  memcpy (r->name, name, l + 1);
+  memcpy (r->path, name, l);
+  memcpy (r->path + l, "/stat", sizeof "/stat");
+  return n + 1;
 }
 
+static unsigned long long now_usec (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
 
 void for_each_pinfo (void (*func) (struct pinfo *info, void *data), void *data)
 {
+  struct linux_dirent64 *d;
   struct pinfo info;
-  DIR *d;
+  unsigned long long t;
+  unsigned long procs = stats.procs;
+  long n, off;
+  int queued = 0;
 
-  d = opendir (PROCDIR);
-  if (d < 0) errx (EXIT_FAILURE, NULL);
+  t = now_usec ();
+  open_procdir ();
+  lseek (proc_fd, 0, SEEK_SET);
+  stats.syscalls++;
+  stats.scans++;
 
-  while (get_pinfo (&info, d) ) {
-    (*func) (&info, data);
+  for (;;) {
+    n = syscall (SYS_getdents64, proc_fd, dents, DENTS_SIZE);
+    stats.syscalls++;
+    if (n <= 0) break;
+    for (off = 0; off < n; off += d->d_reclen) {
+      d = (struct linux_dirent64 *) (dents + off);
+      if (!isdigit (d->d_name[0])) continue;
+      if (batch) {
+	queued = add_batch (queued, d->d_name);
+	if (queued == URING_BATCH) {
+	  flush_batch (queued, func, data);
+	  queued = 0;
+	}
+	continue;
+      }
+      if (!stat_pinfo (d->d_name, &info)) continue;
+      stats.procs++;
+      (*func) (&info, data);
+    }
   }
+  if (queued) flush_batch (queued, func, data);
+  owners_size (stats.procs - procs);
+  stats.last_usec = now_usec () - t;
+  stats.total_usec += stats.last_usec;
+}
 
-  closedir (d);
+void get_scan_stats (struct scan_stats *s)
+{
+  *s = stats;
 }
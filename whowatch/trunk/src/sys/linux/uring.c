@@ -0,0 +1,280 @@
+/*
+ * io_uring backend for the /proc scanner. For every process four
+ * requests are queued: openat of <pid>/stat into a registered file
+ * slot, read and close of that slot (hard linked, so the slot is
+ * always released) and statx of <pid> to get the owner. A whole
+ * batch is submitted and reaped with a single io_uring_enter().
+ * Rings are set up with raw system calls, liburing is not needed.
+ *
+ * Opening into a file slot needs Linux 5.15. Older kernels that
+ * have the opcodes ignore the slot and return a plain descriptor,
+ * so a test open is made before the ring is used.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "machine.h"
+
+#if defined HAVE_LINUX_IO_URING_H && \
+    defined HAVE_STRUCT_IO_URING_SQE_FILE_INDEX
+
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+
+#define RING_ENTRIES	(4 * URING_BATCH)
+#define OPS		4
+
+enum { OP_OPEN, OP_READ, OP_CLOSE, OP_STATX };
+
+static struct {
+	int fd;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+} ring = { -1 };
+
+static int dir_fd;
+static struct statx stx[URING_BATCH];
+
+static inline int uring_enter(unsigned submit, unsigned wait)
+{
+	return syscall(__NR_io_uring_enter, ring.fd, submit, wait,
+		       IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static bool ops_supported(void)
+{
+	static const int ops[] = { IORING_OP_OPENAT, IORING_OP_READ,
+				   IORING_OP_CLOSE, IORING_OP_STATX };
+	struct io_uring_probe *p;
+	bool ok = true;
+	int i, n = 256;
+
+	p = calloc(1, sizeof *p + n * sizeof p->ops[0]);
+	if (!p) return false;
+	if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PROBE,
+		    p, n) == -1) {
+		free(p);
+		return false;
+	}
+	for (i = 0; i < sizeof ops / sizeof *ops; i++)
+		if (ops[i] >= p->ops_len ||
+		    !(p->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+			ok = false;
+	free(p);
+	return ok;
+}
+
+static struct io_uring_sqe *get_sqe(unsigned *tail, int op, int i)
+{
+	struct io_uring_sqe *sqe;
+	unsigned idx = (*tail)++ & *ring.sq_mask;
+
+	sqe = &ring.sqes[idx];
+	memset(sqe, 0, sizeof *sqe);
+	sqe->user_data = i * OPS + op;
+	ring.sq_array[idx] = idx;
+	return sqe;
+}
+
+/*
+ * Submit what is queued up to tail, one request, and return its
+ * result. -1 if it didn't complete.
+ */
+static int run_one(unsigned tail)
+{
+	unsigned head;
+	int res;
+
+	__atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+	if (uring_enter(1, 1) == -1) return -1;
+	head = *ring.cq_head;
+	if (head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE))
+		return -1;
+	res = ring.cqes[head & *ring.cq_mask].res;
+	__atomic_store_n(ring.cq_head, head + 1, __ATOMIC_RELEASE);
+	return res;
+}
+
+/*
+ * Open the directory into the first slot and close it again. A
+ * kernel that knows slots returns 0, an older one a descriptor.
+ */
+static bool slots_supported(void)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail = *ring.sq_tail;
+	int res;
+
+	sqe = get_sqe(&tail, OP_OPEN, 0);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = dir_fd;
+	sqe->addr = (unsigned long) ".";
+	sqe->open_flags = O_RDONLY | O_DIRECTORY;
+	sqe->file_index = 1;
+	if ((res = run_one(tail)) > 0) close(res);
+	if (res != 0) return false;
+
+	sqe = get_sqe(&tail, OP_CLOSE, 0);
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->file_index = 1;
+	return run_one(tail) == 0;
+}
+
+/*
+ * Set up the ring and register an empty table of file slots.
+ * Returns -1 (errno set) if io_uring can't be used here.
+ */
+int uring_init(int dirfd)
+{
+	struct io_uring_params p;
+	size_t sq_size, cq_size;
+	char *sq, *cq;
+	int slots[URING_BATCH];
+	int i;
+
+	if (ring.fd != -1) return 0;
+	memset(&p, 0, sizeof p);
+	if ((ring.fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &p)) == -1)
+		return -1;
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP && cq_size > sq_size)
+		sq_size = cq_size;
+	sq = mmap(0, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		  ring.fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED) goto fail;
+	cq = sq;
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		cq = mmap(0, cq_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED) goto fail;
+	}
+	ring.sqes = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe),
+			 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			 ring.fd, IORING_OFF_SQES);
+	if (ring.sqes == MAP_FAILED) goto fail;
+
+	ring.sq_tail = (unsigned *) (sq + p.sq_off.tail);
+	ring.sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+	ring.sq_array = (unsigned *) (sq + p.sq_off.array);
+	ring.cq_head = (unsigned *) (cq + p.cq_off.head);
+	ring.cq_tail = (unsigned *) (cq + p.cq_off.tail);
+	ring.cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+	if (!ops_supported()) {
+		errno = EOPNOTSUPP;
+		goto fail;
+	}
+	for (i = 0; i < URING_BATCH; i++)
+		slots[i] = -1;
+	if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_FILES,
+		    slots, URING_BATCH) == -1)
+		goto fail;
+	dir_fd = dirfd;
+	if (!slots_supported()) {
+		errno = EOPNOTSUPP;
+		goto fail;
+	}
+	return 0;
+fail:
+	i = errno;
+	close(ring.fd);
+	ring.fd = -1;
+	errno = i;
+	return -1;
+}
+
+/*
+ * Read stat files and owners of n processes. Returns -1 if the
+ * ring stopped working, the caller should fall back then.
+ */
+int uring_read(struct uring_req *r, int n, unsigned long *syscalls)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned tail, head;
+	int i, done, res, op;
+
+	tail = *ring.sq_tail;
+	for (i = 0; i < n; i++) {
+		r[i].len = -1;
+		r[i].euid = -1;
+
+		sqe = get_sqe(&tail, OP_OPEN, i);
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = dir_fd;
+		sqe->addr = (unsigned long) r[i].path;
+		sqe->open_flags = O_RDONLY;
+		sqe->file_index = i + 1;
+		sqe->flags = IOSQE_IO_HARDLINK;
+
+		sqe = get_sqe(&tail, OP_READ, i);
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = i;
+		sqe->addr = (unsigned long) r[i].buf;
+		sqe->len = sizeof r[i].buf - 1;
+		sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+		sqe = get_sqe(&tail, OP_CLOSE, i);
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->file_index = i + 1;
+
+		sqe = get_sqe(&tail, OP_STATX, i);
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = dir_fd;
+		sqe->addr = (unsigned long) r[i].name;
+		sqe->len = STATX_UID;
+		sqe->off = (unsigned long) &stx[i];
+	}
+	__atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+	(*syscalls)++;
+	if (uring_enter(n * OPS, n * OPS) == -1 && errno != EINTR)
+		return -1;
+	for (done = 0; done < n * OPS; ) {
+		head = *ring.cq_head;
+		if (head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+			(*syscalls)++;
+			if (uring_enter(0, 1) == -1 && errno != EINTR)
+				return -1;
+			continue;
+		}
+		cqe = &ring.cqes[head & *ring.cq_mask];
+		i = cqe->user_data / OPS;
+		op = cqe->user_data % OPS;
+		res = cqe->res;
+		if (op == OP_READ && res >= 0) r[i].len = res;
+		if (op == OP_STATX && res == 0) r[i].euid = stx[i].stx_uid;
+		__atomic_store_n(ring.cq_head, head + 1, __ATOMIC_RELEASE);
+		done++;
+	}
+	return 0;
+}
+
+#else /* no io_uring with file slots */
+
+int uring_init(int dirfd)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int uring_read(struct uring_req *r, int n, unsigned long *syscalls)
+{
+	return -1;
+}
+
+#endif
@@ -0,0 +1,197 @@
+/*
+ * Trace of what the program did lately. trace_event() puts a record
+ * of the time, an event and three numbers into a ring of TRACE_SIZE
+ * records, which costs a clock read and a few stores, so it is
+ * always on. The ring is written to /tmp/whowatch-PID.trace on
+ * SIGUSR2 and when the program crashes, from the signal handler,
+ * and "whowatch --trace FILE" prints such a file.
+ *
+ * A slot is taken with an atomic increment, so a signal handler
+ * that traces in the middle of another record only loses that
+ * one. A record being written when the ring is dumped may come
+ * out torn.
+ */
+#include "config.h"
+
+#include <err.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "whowatch.h"
+
+#define TRACE_SIZE	4096		/* records, a power of two	*/
+#define TRACE_MAGIC	"whowatch-trace1"
+#define TRACE_DUMP	"/tmp/whowatch-%d.trace"
+
+struct trace_rec
+{
+	uint64_t ns;			/* CLOCK_MONOTONIC		*/
+	uint32_t event;
+	int32_t arg[3];
+};
+
+struct trace_head
+{
+	char magic[16];
+	uint32_t rec_size;
+	uint32_t count;			/* records that follow		*/
+	int64_t wall;			/* realtime - monotonic, in ns	*/
+	uint64_t written;		/* since the start		*/
+};
+
+static struct
+{
+	const char *name;
+	const char *arg[3];
+} events[TRACE_EVENTS] = {
+	[TR_START] = { "start", { "pid" } },
+	[TR_TICK] = { "tick", { "n", "ticks" } },
+	[TR_KEY] = { "key", { "key" } },
+	[TR_REFRESH] = { "refresh" },
+	[TR_PHASE] = { "phase", { "phase", "us", "calls" } },	/* see prof.c */
+	[TR_HELP] = { "help" },
+	[TR_MENU_KEY] = { "menu_key", { "key", "accepted" } },
+	[TR_EXIT] = { "exit" },
+	[TR_SIGNAL] = { "signal", { "sig", "pid", "ok" } },
+	[TR_SIGNAL_LIST] = { "signal_list", { "pid" } },
+	[TR_SUB_KEY] = { "sub_key", { "key", "arrow" } },
+	[TR_PAD_DRAW] = { "pad_draw", { "lines", "flags" } },
+	[TR_PLUGIN] = { "plugin", { "loaded", "type" } },
+	[TR_USERS] = { "users", { "lines" } },
+	[TR_SEARCH] = { "search", { "line", "matches" } },
+	[TR_CONN] = { "conn", { "inode", "state", "new" } },
+	[TR_CRASH] = { "crash", { "sig" } },
+};
+
+static struct trace_rec ring[TRACE_SIZE];
+static uint64_t written;
+static int64_t wall;
+static char dump_path[64];
+
+void trace_event(int event, int a, int b, int c)
+{
+	uint64_t i = __atomic_fetch_add(&written, 1, __ATOMIC_RELAXED);
+	struct trace_rec *r = &ring[i & (TRACE_SIZE - 1)];
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	r->ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	r->event = event;
+	r->arg[0] = a;
+	r->arg[1] = b;
+	r->arg[2] = c;
+}
+
+/*
+ * Write the ring, oldest record first. Only async-signal-safe
+ * calls are made here.
+ */
+static void dump(void)
+{
+	struct trace_head h;
+	uint64_t n = __atomic_load_n(&written, __ATOMIC_RELAXED);
+	size_t first;
+	int fd;
+
+	if ((fd = open_dump(dump_path)) == -1) return;
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, TRACE_MAGIC, sizeof TRACE_MAGIC);
+	h.rec_size = sizeof *ring;
+	h.count = n < TRACE_SIZE ? n : TRACE_SIZE;
+	h.wall = wall;
+	h.written = n;
+	first = n < TRACE_SIZE ? 0 : n & (TRACE_SIZE - 1);
+	if (write(fd, &h, sizeof h) == sizeof h &&
+	    write(fd, ring + first, (h.count - first) * sizeof *ring) >= 0)
+		write(fd, ring, first * sizeof *ring);
+	close(fd);
+}
+
+static void dump_signal(int sig)
+{
+	dump();
+}
+
+static void crash_signal(int sig)
+{
+	trace_event(TR_CRASH, sig, 0, 0);
+	dump();
+	raise(sig);			/* the handler is reset by now	*/
+}
+
+/*
+ * Handlers are installed directly and not through the main loop,
+ * so a dump is written even when the loop is stuck.
+ */
+void trace_init(void)
+{
+	static const int crash[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+	struct timespec mono, real;
+	struct sigaction sa;
+	int i;
+
+	snprintf(dump_path, sizeof dump_path, TRACE_DUMP, (int) getpid());
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	clock_gettime(CLOCK_REALTIME, &real);
+	wall = (real.tv_sec - mono.tv_sec) * 1000000000LL +
+		real.tv_nsec - mono.tv_nsec;
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = dump_signal;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR2, &sa, 0);
+	sa.sa_handler = crash_signal;
+	sa.sa_flags = SA_RESETHAND;
+	for (i = 0; i < sizeof crash / sizeof *crash; i++)
+		sigaction(crash[i], &sa, 0);
+	trace_event(TR_START, getpid(), 0, 0);
+}
+
+/*
+ * Print a dump, one record per line.
+ */
+void trace_print(const char *path)
+{
+	struct trace_head h;
+	struct trace_rec r;
+	uint64_t prev = 0;
+	char when[32];
+	time_t sec;
+	FILE *f;
+	int i, k;
+
+	if (!(f = fopen(path, "r")))
+		err(EXIT_FAILURE, "%s", path);
+	if (fread(&h, sizeof h, 1, f) != 1 ||
+	    memcmp(h.magic, TRACE_MAGIC, sizeof TRACE_MAGIC) ||
+	    h.rec_size != sizeof r)
+		errx(EXIT_FAILURE, "%s: not a trace", path);
+	if (h.written > h.count)
+		printf("(%llu older records were overwritten)\n",
+		       (unsigned long long) (h.written - h.count));
+	for (i = 0; i < h.count && fread(&r, sizeof r, 1, f) == 1; i++) {
+		sec = (r.ns + h.wall) / 1000000000;
+		strftime(when, sizeof when, "%b %e %H:%M:%S", localtime(&sec));
+		printf("%s.%06llu %+10.6f ", when,
+		       (unsigned long long) (r.ns + h.wall) % 1000000000 / 1000,
+		       i ? (double) (int64_t) (r.ns - prev) / 1e9 : 0.0);
+		prev = r.ns;
+		if (r.event >= TRACE_EVENTS || !events[r.event].name) {
+			printf("event%u %d %d %d\n", r.event, r.arg[0],
+			       r.arg[1], r.arg[2]);
+			continue;
+		}
+		printf("%s", events[r.event].name);
+		k = 0;
+		if (r.event == TR_PHASE && prof_name(r.arg[0]))
+			printf(" %s", prof_name(r.arg[k++]));
+		for (; k < 3 && events[r.event].arg[k]; k++)
+			printf(" %s=%d", events[r.event].arg[k], r.arg[k]);
+		printf("\n");
+	}
+	fclose(f);
+}
@@ -1,22 +1,41 @@
 #include "config.h"
 
-#ifdef HAVE_PATHS_H
-#include <paths.h>
-#endif
 #ifdef HAVE_UTMP_H
 #include <utmp.h>
 #endif
-#include <err.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+#include <fcntl.h>
+#include <libgen.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "whowatch.h"
+#include "proctree.h"
+#include "machine.h"
 
 #define LOGIN		1
 #define LOGOUT		-1		
 
-LIST_HEAD(users_l);
+/*
+ * Users in display order, the line number of a user is its rank.
+ * Logouts find the user by tty in a hash table, the newest login
+ * on a tty comes first in its chain. A logout takes the newest
+ * login on its tty, as the walk of the old list did.
+ */
+static struct os_tree lines;
+static struct user_t **tty_hash;
+static unsigned int hash_size;		/* power of two			*/
+
+#define TTY_HASH_MIN	64
+
 static bool toggle;	/* if false show cmd line else show idle time 	*/
+static int dev_fd = -1;	/* for the idle time of ttys			*/
+static bool frozen;	/* users come from a recording, see users_sync	*/
 
 char *line_buf;		/* global buffer for line printing		*/
 int buf_size;		/* allocated buffer size			*/
@@ -51,7 +70,7 @@ static void u_count(char *name, int p)
 	int i;
 	struct prot_t *t;
 	users_list.d_lines += p;
-	dolog("%s : dlines %d\n", __FUNCTION__, users_list.d_lines);	
+	trace_event(TR_USERS, users_list.d_lines, 0, 0);
 	for(i = 0; i < sizeof prot_tab/sizeof(struct prot_t); i++){
 		t = &prot_tab[i];
 		if (strncmp(t->s, name, strlen(t->s)) != 0) continue;
@@ -59,19 +78,78 @@ static void u_count(char *name, int p)
 	}
 }
 
+#define node_user(n)	((struct user_t *) (n))
+
+static inline int user_line(struct user_t *u)
+{
+	return os_rank(&u->node);
+}
+
+static inline struct user_t *user_at(int line)
+{
+	if (line < 0) return 0;
+	return node_user(os_select(&lines, line));
+}
+
+static inline struct user_t *user_next(struct user_t *u)
+{
+	return node_user(os_next(&u->node));
+}
+
+/* FNV-1a */
+static unsigned int tty_hash_fn(const char *tty)
+{
+	unsigned int h = 2166136261u;
+
+	while (*tty)
+		h = (h ^ (unsigned char) *tty++) * 16777619;
+	return h & (hash_size - 1);
+}
+
+static void hash_add(struct user_t *u)
+{
+	unsigned int h = tty_hash_fn(u->tty);
+
+	u->next_tty = tty_hash[h];
+	tty_hash[h] = u;
+}
+
 /*
- * After deleting line, update line numbers in each user structure 
+ * Keep chains short. Users are added again oldest first, so the
+ * newest still ends up first in its chain.
  */
-static void update_line(int line)
+static void hash_grow(void)
 {
 	struct user_t *u;
-	struct list_head *tmp;
-	list_for_each(tmp, &users_l) {
-		u = list_entry(tmp, struct user_t, head); 
-		if(u->line > line) u->line--;
-	}	
+
+	free(tty_hash);
+	hash_size = hash_size ? hash_size * 2 : TTY_HASH_MIN;
+	tty_hash = xcalloc(hash_size, sizeof *tty_hash);
+	for (u = node_user(os_first(&lines)); u; u = user_next(u))
+		hash_add(u);
+}
+
+static void hash_del(struct user_t *u)
+{
+	struct user_t **p = &tty_hash[tty_hash_fn(u->tty)];
+
+	for (; *p; p = &(*p)->next_tty)
+		if (*p == u) {
+			*p = u->next_tty;
+			break;
+		}
 }
-			
+
+static struct user_t *find_tty(const char *tty)
+{
+	struct user_t *u;
+
+	if (!hash_size) return 0;
+	for (u = tty_hash[tty_hash_fn(tty)]; u; u = u->next_tty)
+		if (!strcmp(u->tty, tty)) break;
+	return u;
+}
+
 /* 
  * Create new user structure and fill it
  */
@@ -89,40 +167,85 @@ static struct user_t *alloc_user(struct utmpx *entry)
  	if((ppid = get_ppid(u->pid)) == -1)
 		strncpy(u->parent, "can't access", sizeof u->parent);
 	else 	strncpy(u->parent, get_name(ppid), sizeof u->parent - 1);
-	
-	u->line = users_list.d_lines;
 	return u;
 }
 
+/*
+ * New users go to the end of the list.
+ */
 static struct user_t* new_user(struct utmpx *ut)
 {
 	struct user_t *u;
 	u = alloc_user(ut);
-	list_add(&u->head, &users_l);
+	os_insert(&lines, &u->node, os_count(&lines));
+	if (os_count(&lines) > hash_size) hash_grow();
+	else hash_add(u);
 	u_count(u->parent, LOGIN);
 	return u;
 }
 	
-static void print_user(struct user_t *u)
+/*
+ * Read the foreground command and idle time of the session again.
+ * Returns true if the one that is shown has changed.
+ */
+static bool session_update(struct user_t *u)
+{
+	char idle[sizeof u->idle], *w = "-";
+	struct pinfo i;
+	struct stat st;
+	bool changed = false;
+
+	u->updated = ticks + 1;
+	u->tpgid = get_pinfo(u->pid, &i) ? i.tpgid : -1;
+	if (u->tpgid > 0 && get_pinfo(u->tpgid, &i))
+		w = cmdline_lookup(&i);
+	if (!u->what || strcmp(u->what, w)) {
+		free(u->what);
+		u->what = xstrdup(w);
+		changed = !toggle;
+	}
+	if (u->full != full_cmd) {
+		u->full = full_cmd;
+		changed = !toggle;
+	}
+	if (dev_fd == -1 || fstatat(dev_fd, u->tty, &st, 0) == -1)
+		strcpy(idle, "?");
+	else format_idle(time(0) - st.st_atime, idle, sizeof idle);
+	if (strcmp(u->idle, idle)) {
+		strcpy(u->idle, idle);
+		changed |= toggle;
+	}
+	return changed;
+}
+
+/*
+ * The last column, read at most once a tick.
+ */
+static char *last_column(struct user_t *u)
+{
+	if (!frozen && (u->updated != ticks + 1 || u->full != full_cmd))
+		session_update(u);
+	return toggle ? u->idle : u->what;
+}
+
+static void print_user(struct user_t *u, int line)
 {
 	wattrset(users_list.wd, A_BOLD);
 	snprintf(line_buf, buf_size, 
-		"%-14.14s %-9.9s %-6.6s %-19.19s %s",
-		u->parent, u->name, u->tty, u->host, 
-		toggle?count_idle(u->tty):get_w(u->pid));
+		USER_FORMAT,
+		u->parent, u->name, u->tty, u->host, last_column(u));
 	line_buf[buf_size - 1] = 0;
-	print_line(&users_list, line_buf , u->line, 0);
+	print_line(&users_list, line_buf , line, 0);
 }
 
 void users_list_refresh(void)
 {
-	struct list_head *tmp;
 	struct user_t *u;
-	list_for_each_r(tmp, &users_l) {
-		u = list_entry(tmp, struct user_t, head);
-		if(above(u->line, &users_list)) continue;
-		if(below(u->line, &users_list)) break;
-		print_user(u);
+	int line = users_list.offset;
+
+	for (u = user_at(line); u; u = user_next(u), line++) {
+		if(below(line, &users_list)) break;
+		print_user(u, line);
 	}
 }
 	
@@ -133,11 +256,10 @@ void users_list_refresh(void)
 static void read_utmp(void)		
 {
 	struct utmpx *entry;
-	struct user_t *u;
 	
 	while ((entry = getutxent()) != NULL) {
 	  if (entry->ut_type == USER_PROCESS) {
-	    u = new_user (entry);
+	    new_user (entry);
 	    //		print_user(u);
 	  }
 	}
@@ -152,22 +274,16 @@ static void read_utmp(void)
  */
 struct user_t *cursor_user(void)	
 {
-	struct user_t *u;
-	struct list_head *h;
-	int line = current->cursor + current->offset;
-	list_for_each(h, &users_l) {
-		u = list_entry(h, struct user_t, head);
-		if(u->line == line) return u;
-	}
-	return 0;
+	return user_at(current->cursor + current->offset);
 }
 
 static void del_user(struct user_t *u)
 {
-	delete_line(&users_list, u->line);
-	update_line(u->line);
+	if (users_list.wd) delete_line(&users_list, user_line(u));
 	u_count(u->parent, LOGOUT);
-	list_del(&u->head);
+	hash_del(u);
+	os_delete(&lines, &u->node);
+	free(u->what);
 	free(u);
 }
 
@@ -185,77 +301,154 @@ werase(info_win.wd);
         wnoutrefresh(info_win.wd);
 }
 
+static void wtmp_record(struct utmpx *entry, void *changed)
+{
+	char tty[member_size(struct utmpx, ut_line) + 1];
+	struct user_t *u;
+
+	/* user just logged in */
+	if (entry->ut_type == USER_PROCESS) {
+		u = new_user (entry);
+		*(bool *) changed = true;
+		return;
+	}
+	if (entry->ut_type == DEAD_PROCESS) {
+	  /* user just logged out */
+	  strncpy(tty, entry->ut_line, sizeof tty - 1);
+	  tty[sizeof tty - 1] = 0;
+	  if ((u = find_tty(tty))) {
+	    del_user(u);	
+	    *(bool *) changed = true;
+	  }
+	}
+}
+
 /*
- * Check wtmp for logouts or new logins
+ * Read new wtmp records. Returns true if the list has changed.
  */
-void check_wtmp (void)
+static bool read_wtmp(void)
 {
-	struct user_t *u;
-	struct list_head *h;
-	struct utmpx *entry;
-	bool show, changed;
+	bool changed = false;
+
+	prof_begin(PROF_WTMP);
+	wtmp_read(wtmp_record, &changed);
+	prof_end(PROF_WTMP);
+	if (changed && users_list.wd) {
+	  if (current == &users_list) users_list_refresh();
+	  if (current != &history_win) print_info();
+	}
+	return changed;
+}
 
-	show = (current == &users_list);
-	changed = false;
-	while ((entry = getutxent()) != NULL) {
-		/* user just logged in */
-		if (entry->ut_type == USER_PROCESS) {
-			u = new_user (entry);
-			changed = true;
-			continue;
-		}
-		if (entry->ut_type == DEAD_PROCESS) {
-		  /* user just logged out */
-		  list_for_each(h, &users_l) {
-		    u = list_entry(h, struct user_t, head);
-		    if(strncmp(u->tty, entry->ut_line, sizeof(entry->ut_line)))
-		      continue;
-		    del_user(u);	
-		    changed = true;
-		    break;
-		  }
+#ifdef HAVE_SYS_INOTIFY_H
+
+/*
+ * wtmp is read only when inotify says it has changed. The directory
+ * is watched too, to notice a new file after log rotation.
+ */
+#define WTMP_EVENTS	(IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF)
+#define DIR_EVENTS	(IN_CREATE | IN_MOVED_TO)
+
+static int wtmp_fd = -1;		/* inotify descriptor		*/
+static int wtmp_wd = -1, dir_wd = -1;
+static const char *wtmp_name;		/* last part of wtmp_file	*/
+
+static void wtmp_ready(int fd, void *unused)
+{
+	char buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+	const struct inotify_event *ev;
+	char *p;
+	bool rotated = false;
+	int n;
+
+	while ((n = read(fd, buf, sizeof buf)) > 0)
+		for (p = buf; p < buf + n; p += sizeof *ev + ev->len) {
+			ev = (const struct inotify_event *) p;
+			if (ev->wd == dir_wd && ev->len &&
+			    !strcmp(ev->name, wtmp_name))
+				rotated = true;
 		}
+	if (rotated) {
+		if (wtmp_wd != -1)
+			inotify_rm_watch(wtmp_fd, wtmp_wd);
+		wtmp_wd = inotify_add_watch(wtmp_fd, wtmp_file, WTMP_EVENTS);
 	}
-	if (changed) {
-	  if (show) users_list_refresh();
-	  print_info();
+	if (read_wtmp()) refresh_screen();
+}
+
+static bool watch_wtmp(void)
+{
+	char *dir = xstrdup(wtmp_file);
+
+	wtmp_name = (wtmp_name = strrchr(wtmp_file, '/')) ? wtmp_name + 1 :
+		wtmp_file;
+	wtmp_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (wtmp_fd == -1) return false;
+	wtmp_wd = inotify_add_watch(wtmp_fd, wtmp_file, WTMP_EVENTS);
+	dir_wd = inotify_add_watch(wtmp_fd, dirname(dir), DIR_EVENTS);
+	free(dir);
+	if (wtmp_wd == -1 && dir_wd == -1) {
+		close(wtmp_fd);
+		wtmp_fd = -1;
+		return false;
 	}
+	loop_add_fd(wtmp_fd, wtmp_ready, 0);
+	return true;
+}
+
+#else
+
+static bool watch_wtmp(void)
+{
+	return false;
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
+static bool wtmp_watched;
+
+/*
+ * Check wtmp for logouts or new logins. Called every tick, unless
+ * changes of the file are watched.
+ */
+void check_wtmp (void)
+{
+	if (!wtmp_watched && !frozen) read_wtmp();
 }
 
 static char *users_list_giveline(int line)
 {
 	struct user_t *u;
-	struct list_head *h;	
-	list_for_each(h, &users_l) {
-		u = list_entry(h, struct user_t, head);
-		if (line != u->line) continue;
-		snprintf(line_buf, buf_size, 
-			"%-14.14s %-9.9s %-6.6s %-19.19s %s", 
-			u->parent, u->name, u->tty, u->host, 
-				toggle?count_idle(u->tty):get_w(u->pid));
-		return line_buf;
-	}
-	return "not available";
+
+	if (!(u = user_at(line))) return "not available";
+	snprintf(line_buf, buf_size, 
+		USER_FORMAT, 
+		u->parent, u->name, u->tty, u->host, last_column(u));
+	return line_buf;
 }
 
-static void cmdline(void)
+/*
+ * Update the last column of all visible users in one pass and
+ * repaint the cells that have changed, or all of them.
+ */
+static void cmdline(bool all)
 {
         struct window *q = &users_list;
         struct user_t *u;
-        struct list_head *h;
-        int y, x;
+        int y, x, line = q->offset;
+	bool changed;
 
 	if(CMD_COLUMN >= screen_cols) return;
-        list_for_each(h, &users_l) {
-                u = list_entry(h, struct user_t, head);
-//                if(u->line < q->offset ||
-  //                      u->line > q->offset + q->rows - 1)
-		if(outside(u->line, q)) continue;
-		wmove(q->wd, u->line - q->offset, CMD_COLUMN);
+        for (u = user_at(line); u; u = user_next(u), line++) {
+		if(below(line, q)) break;
+		changed = !frozen && u->updated != ticks + 1 &&
+			session_update(u);
+		if (!changed && !all) continue;
+		wmove(q->wd, line - q->offset, CMD_COLUMN);
                 cursor_off(q, q->cursor);
                 wattrset(q->wd, A_BOLD);
-                wmove(q->wd, u->line - q->offset, CMD_COLUMN);
-                waddnstr(q->wd, toggle?count_idle(u->tty):get_w(u->pid),
+                wmove(q->wd, line - q->offset, CMD_COLUMN);
+                waddnstr(q->wd, last_column(u),
                          COLS - CMD_COLUMN - 1);
                 getyx(q->wd, y, x);
                 while(x++ < q->cols + 1)
@@ -284,9 +477,17 @@ static bool ulist_key(int key)
 		sub_switch();
 		pad_draw();
 		break;
+	case 'h':
+		werase(main_win);
+		current = &history_win;
+		print_help();
+		show_history();
+		sub_switch();
+		pad_draw();
+		break;
         case 'i':
                 toggle = !toggle;
-                cmdline();
+                cmdline(true);
                 break;
         default:
 	        return KEY_SKIPPED;
@@ -296,59 +497,144 @@ static bool ulist_key(int key)
 
 static void periodic(void)
 {
-	cmdline();
+	cmdline(false);
+}
+
+/*
+ * Read who is logged in and start following wtmp. Nothing is drawn,
+ * batch mode needs only this.
+ */
+void users_open(void)
+{
+#ifdef HAVE_UTMPNAME
+	utmpname(utmp_file);
+#endif
+	setutxent ();
+	read_utmp();
+	endutxent ();
+
+	dev_fd = open("/dev", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	wtmp_open(wtmp_file);
+}
+
+/* 
+ * Needed for search function. True if parent, name, tty, host or
+ * command line of the user on the line matches.
+ */
+static bool user_match(int line)
+{
+	struct user_t *u = user_at(line);
+
+	if(!u) return false;
+	return reg_match(u->parent) || reg_match(u->name) ||
+		reg_match(u->tty) || reg_match(u->host) ||
+		reg_match(last_column(u));
 }
 
-void users_init(void)
+/*
+ * Without live the list stays empty until users_sync() fills it.
+ */
+void users_init(bool live)
 {
 	users_list.giveme_line = users_list_giveline;
 	users_list.keys = ulist_key;
 	users_list.periodic = periodic;
 	users_list.redraw = users_list_refresh;
+	users_list.match = user_match;
 
-	setutxent ();
-	read_utmp();
-	endutxent ();
+	frozen = !live;
+	if (live) {
+		users_open();
+		wtmp_watched = watch_wtmp();
+	}
+	print_info();
+}
 
-	// open wtmp database
-#ifdef HAVE_UTMPNAME
-	if (utmpname (_PATH_WTMP) == -1) {
-	  err(1, "%s: cannot open wtmp database",
-	      __FUNCTION__);
+/*
+ * Stop taking users from users_sync() and read utmp and wtmp again.
+ */
+void users_live(void)
+{
+	struct user_t *u, *next;
+
+	for (u = node_user(os_first(&lines)); u; u = next) {
+		next = user_next(u);
+		del_user(u);
 	}
-#else
-	if (setutxdb (UTXDB_LOG, NULL) == -1) {
-	  err(1, "%s: cannot open wtmp database",
-	      __FUNCTION__);
+	frozen = false;
+	users_open();
+	wtmp_watched = watch_wtmp();
+	if (current == &users_list) users_list_refresh();
+	if (current != &history_win) print_info();
+}
+
+static unsigned long long sync_gen;
+
+static void sync_user(struct user_t *src, void *unused)
+{
+	struct user_t *u;
+
+	for (u = find_tty(src->tty); u; u = u->next_tty)
+		if (u->pid == src->pid && !strcmp(u->tty, src->tty)) break;
+	if (!u) {
+		u = xcalloc(1, sizeof *u);
+		strcpy(u->name, src->name);
+		strcpy(u->tty, src->tty);
+		strcpy(u->host, src->host);
+		strcpy(u->parent, src->parent);
+		u->pid = src->pid;
+		os_insert(&lines, &u->node, os_count(&lines));
+		if (os_count(&lines) > hash_size) hash_grow();
+		else hash_add(u);
+		u_count(u->parent, LOGIN);
 	}
-#endif
-	setutxent ();
-	// skip to end
-	while (getutxent()) ;
+	if (!u->what || strcmp(u->what, src->what)) {
+		free(u->what);
+		u->what = xstrdup(src->what);
+	}
+	strcpy(u->idle, src->idle);
+	u->updated = sync_gen;
+}
 
-	print_info();
+/*
+ * Make the list what each() passes to its function, users that are
+ * not passed are logged out. The last column is taken as it is.
+ */
+void users_sync(int (*each)(void (*func)(struct user_t *u, void *data),
+			    void *data))
+{
+	struct user_t *u, *next;
+
+	frozen = true;
+	sync_gen++;
+	each(sync_user, 0);
+	for (u = node_user(os_first(&lines)); u; u = next) {
+		next = user_next(u);
+		if (u->updated != sync_gen) del_user(u);
+	}
+	if (!users_list.wd) return;
+	if (current == &users_list) {
+		users_list_refresh();
+		cmdline(true);
+	}
+	if (current != &history_win) print_info();
 }
 
-/* 
- * Needed for search function. If parent, name, tty, host or command line
- * matches then returns line number of this user.
+/*
+ * Pass every user, in the order of the list and with the last
+ * column up to date, to func. Returns the number of users.
  */
-unsigned int user_search(int line)
+int users_for_each(void (*func)(struct user_t *u, void *data), void *data)
 {
 	struct user_t *u;
-	struct list_head *h;
-	
-	list_for_each(h, &users_l) {
-		u = list_entry(h, struct user_t, head);
-		if(u->line < line) continue;
-		if(reg_match(u->parent)) return u->line;
-		if(reg_match(u->name)) return u->line;
-		if(reg_match(u->tty)) return u->line;
-		if(reg_match(u->host)) return u->line;
-		if(reg_match(toggle?count_idle(u->tty):get_w(u->pid))) 
-			return u->line;
+	int n = 0;
+
+	for (u = node_user(os_first(&lines)); u; u = user_next(u), n++) {
+		last_column(u);
+		func(u, data);
 	}
-	return -1;
+	return n;
 }
 
 
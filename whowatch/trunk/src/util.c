@@ -1,70 +1,17 @@
 #include "config.h"
 
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "whowatch.h"
 
-#ifndef RETURN_TV_IN_SELECT
-
-/*
-  Subtract the `struct timeval' values X and Y,
-  storing the result in RESULT.
-  Return 1 if the difference is negative, otherwise 0.
-  Taken from the glibc manual.
-*/
-static int timeval_subtract (struct timeval *result,
-			     struct timeval *x,
-			     struct timeval *y)
-{
-  /* Perform the carry for the later subtraction by updating Y. */
-  if (x->tv_usec < y->tv_usec) {
-    int nsec = (y->tv_usec - x->tv_usec) / 1000000 + 1;
-    y->tv_usec -= 1000000 * nsec;
-    y->tv_sec += nsec;
-  }
-  if (x->tv_usec - y->tv_usec > 1000000) {
-    int nsec = (x->tv_usec - y->tv_usec) / 1000000;
-    y->tv_usec += 1000000 * nsec;
-    y->tv_sec -= nsec;
-  }
-
-  /* Compute the time remaining to wait. tv_usec is certainly positive. */
-  result->tv_sec = x->tv_sec - y->tv_sec;
-  result->tv_usec = x->tv_usec - y->tv_usec;
-
-  /* Return 1 if result is negative. */
-  return x->tv_sec < y->tv_sec;
-}
-
-#undef select
-int _select (int nfds, fd_set *readfds, fd_set *writefds,
-	     fd_set *exceptfds, struct timeval *timeout)
-{
-  struct timeval before;
-  struct timeval after;
-  struct timeval delta;
-  int retval;
-
-  gettimeofday (&before, 0);
-  retval = select (nfds, readfds, writefds, exceptfds, timeout);
-  gettimeofday (&after, 0);
-  if (timeval_subtract (&delta, &after, &before) == 0) {
-    // after >= before
-    if (timeval_subtract (timeout, timeout, &delta) == 1) {
-      // *timeout < 0
-      timeout->tv_sec = 0;
-      timeout->tv_usec = 0;
-    }
-  }
-  return retval;
-}
-
-#endif /* !RETURN_TV_IN_SELECT */
-
-
 void* xmalloc (size_t size)
 {
   void *ptr = malloc (size);
@@ -92,31 +39,67 @@ void *xrealloc (void *ptr, size_t size)
   return ptr;
 }
 
-
-#ifdef DEBUG
-static FILE *debug_file = NULL;
-#endif
-
-void dolog (const char *format, ...)
+char *xstrdup (const char *s)
 {
-#ifdef DEBUG
-        va_list ap;
-        char *c;
-	time_t tm;
+  char *ptr = strdup (s);
+  if (ptr == NULL) {
+    err (EXIT_FAILURE, NULL);
+  }
+  return ptr;
+}
 
-	if (!debug_file) {
-	  if (!(debug_file = fopen ("whowatch.log", "w"))) {
-	    errx (EXIT_FAILURE, "file debug open error\n");
-	  }
-	}
+/*
+ * Idle time as shown in the users list: days, hours:minutes,
+ * minutes or nothing below a minute.
+ */
+char *format_idle (time_t idle, char *buf, size_t size)
+{
+  if (idle >= 3600 * 24)
+    snprintf (buf, size, "%ldd", (long) idle / (3600 * 24));
+  else if (idle >= 3600)
+    snprintf (buf, size, "%ld:%02ld", (long) idle / 3600,
+	      (long) (idle % 3600) / 60);
+  else if (idle >= 60)
+    snprintf (buf, size, "%ld", (long) idle / 60);
+  else
+    snprintf (buf, size, " ");
+  return buf;
+}
 
-        tm = time (0);
-        c = ctime (&tm);
-        *(c + strlen(c) - 1) = 0;
-        fprintf (debug_file, "%s: ", c);
-        va_start (ap, format);
-        vfprintf (debug_file, format, ap);
-        va_end (ap);
-        fflush (debug_file);
-#endif
+/*
+ * Open a file for a dump in a directory anybody can write to such
+ * as /tmp. It is made with O_EXCL, or if it is there it is used
+ * only when it is a file of ours that nobody else can read, so a
+ * file or link put there by somebody else is never written to.
+ * Otherwise ".1" to ".9" are added to the name, path must have
+ * room for them. Only async-signal-safe calls are made. Returns -1
+ * if no name could be used.
+ */
+int open_dump (char *path)
+{
+  size_t len = strlen (path);
+  struct stat st;
+  int fd = -1, i;
+
+  for (i = 0; i < 10 && fd == -1; i++) {
+    if (i) {
+      path[len] = '.';
+      path[len + 1] = '0' + i;
+      path[len + 2] = '\0';
+    }
+    fd = open (path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+	       0600);
+    if (fd != -1 || errno != EEXIST) continue;
+    /* a FIFO would block the open */
+    fd = open (path, O_WRONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1) continue;
+    if (fstat (fd, &st) || !S_ISREG (st.st_mode) ||
+	st.st_uid != geteuid () || st.st_nlink != 1 ||
+	(st.st_mode & 077) || ftruncate (fd, 0)) {
+      close (fd);
+      fd = -1;
+    }
+  }
+  path[len] = '\0';
+  return fd;
 }
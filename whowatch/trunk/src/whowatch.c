@@ -1,7 +1,13 @@
 #include "config.h"
 
+#ifdef HAVE_PATHS_H
+#include <paths.h>
+#endif
 #include <err.h>
+#include <getopt.h>
+#include <libgen.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -13,19 +19,27 @@
 
 #define TIMEOUT 	3
 
-unsigned long long ticks;	/* increased every TIMEOUT seconds	*/
+#ifndef _PATH_UTMP
+#define _PATH_UTMP	"/var/run/utmp"
+#endif
+
+unsigned long long ticks;	/* increased every interval		*/
 bool full_cmd = true;	/* if 1 then show full cmd line in tree		*/
 int screen_rows;	/* screen rows returned by ioctl  		*/
 int screen_cols;	/* screen cols returned by ioctl		*/
 char *line_buf;		/* global buffer for line printing		*/
 int buf_size;		/* allocated buffer size			*/
+const char *proc_dir = "/proc";
+const char *utmp_file = _PATH_UTMP;
+const char *wtmp_file = _PATH_WTMP;
 
 struct window users_list;
 struct window proc_win;
+struct window history_win;
 struct window *current;
 
-static bool size_changed; 
 static bool signal_sent;
+static bool recording;
 
 struct key_handler {
         int key;
@@ -53,26 +67,32 @@ static bool (*key_funct[])(int) = {
 	box_keys,
 	menu_keys,
 	sub_keys,
+	replay_keys,
 };
 	
 
 /*
- * Process these function after each TIMEOUT (default 3 seconds).
+ * Process these function after each tick (default 3 seconds).
  * Order is important because some windows are on the top
  * of others.
  */
 static void periodic(void)
 {
+	prof_begin(PROF_TICK);
 	check_wtmp();
 	update_load();		
 	current->periodic();
+	if (prof_shown()) print_help();
 	wnoutrefresh(main_win);
 	wnoutrefresh(info_win.wd);
 	sub_periodic();
 	menu_refresh();
 	box_refresh();
 	info_refresh();
+	prof_begin(PROF_UPDATE);
 	doupdate();
+	prof_end(PROF_UPDATE);
+	prof_end(PROF_TICK);
 }
 
 void send_signal(int sig, pid_t pid)
@@ -83,6 +103,7 @@ void send_signal(int sig, pid_t pid)
 	if(pid == INIT_PID) p = -1;
 	else p = kill(pid, sig);
 	signal_sent = true;
+	trace_event(TR_SIGNAL, sig, pid, p != -1);
 	if(p == -1)
 		sprintf(buf,"Can't send signal %d to process %d",
 			sig, pid); 
@@ -106,9 +127,9 @@ static void key_action (int key)
 	 */
 	size = sizeof key_funct/sizeof(int (*)(int));
 	for(i = 0; i < size; i++)
-		if(key_funct[i](key)) goto SKIP; 
+		if(key_funct[i](key)) goto CHANGED; 
 	
-	if(current->keys(key)) goto SKIP;
+	if(current->keys(key)) goto CHANGED;
 	/* cursor movement */
 	size = sizeof key_handlers/sizeof(struct key_handler);
 	for(i = 0; i < size; i++) 
@@ -125,6 +146,14 @@ static void key_action (int key)
 	case '/':
 		m_search();
 		break;			
+	case 'n':
+	case 'N':
+		search_next(key == 'N');
+		break;
+	case 'p':
+		prof_toggle();
+		print_help();
+		break;
 	case KEY_F(1):
 		help();
 		break;
@@ -133,15 +162,26 @@ static void key_action (int key)
 		exit(EXIT_SUCCESS);
 	default: return;
 	}
+	goto SKIP;
+CHANGED:
+	/* the lines may be others now, matches are looked for again */
+	search_forget();
 SKIP:
-	dolog("%s: doing refresh\n", __FUNCTION__);
+	trace_event(TR_REFRESH, 0, 0, 0);
+	refresh_screen();
+}
+
+void refresh_screen(void)
+{
 	wnoutrefresh(main_win);
 	wnoutrefresh(info_win.wd);
 	pad_refresh();
 	menu_refresh();
 	box_refresh();
 	info_refresh();
+	prof_begin(PROF_UPDATE);
 	doupdate();
+	prof_end(PROF_UPDATE);
 }
 
 static void get_rows_cols (int *y, int *x)
@@ -155,16 +195,11 @@ static void get_rows_cols (int *y, int *x)
   *x = win.ws_col;
 }								
 
-static void winch_handler()
-{
-	size_changed = true;
-}
-
 /* 
  * Handle SIGWINCH. Order of calling various resize
  * functions is really important.
  */
-static void resize(void)
+static void resize(int sig)
 {
 	get_rows_cols(&screen_rows, &screen_cols);
 	resizeterm(screen_rows, screen_cols);
@@ -187,34 +222,209 @@ static void resize(void)
 	box_resize();
 	info_resize();
 	doupdate();
-	size_changed = false;
 }
 
-static void int_handler()
+static void int_handler(int sig)
 {
 	exit(EXIT_SUCCESS);
+}
+
+static void tick(unsigned long long n)
+{
+	ticks += n;
+	trace_event(TR_TICK, n, ticks, 0);
+	shared_tick();
+	replay_tick(n);
+	periodic();
+	if (recording) {
+		tree_sync();
+		record_tick();
+	}
+}
+
+static void keys_ready(int fd, void *unused)
+{
+	int key;
+	while ((key = read_key()) != ERR) {
+		trace_event(TR_KEY, key, 0, 0);
+		prof_begin(PROF_KEY);
+		key_action(key);
+		prof_end(PROF_KEY);
+	}
+}
+
+static void events_ready(int fd, void *unused)
+{
+	if (tree_events_ready())
+		refresh_screen();
 }		
 
+static struct option long_options[] = {
+	{ "scanner", required_argument, 0, 's' },
+	{ "events", no_argument, 0, 'e' },
+	{ "interval", required_argument, 0, 'i' },
+	{ "batch", no_argument, 0, 'b' },
+	{ "format", required_argument, 0, 'f' },
+	{ "count", required_argument, 0, 'n' },
+	{ "record", required_argument, 0, 'r' },
+	{ "replay", required_argument, 0, 'R' },
+	{ "daemon", no_argument, 0, 'D' },
+	{ "proc", required_argument, 0, 'P' },
+	{ "utmp", required_argument, 0, 'U' },
+	{ "wtmp", required_argument, 0, 'W' },
+	{ "trace", required_argument, 0, 'T' },
+	{ "help", no_argument, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+static void usage(int status)
+{
+	fprintf(status ? stderr : stdout,
+		"usage: whowatch [options]\n"
+		"  -s, --scanner NAME  how processes are read: plain or uring\n"
+		"  -e, --events        follow process events instead of rescanning\n"
+		"  -i, --interval SEC  seconds between updates (default %d)\n"
+		"  -b, --batch         write snapshots to stdout instead of a screen\n"
+		"  -f, --format FMT    batch output: json (default) or csv\n"
+		"  -n, --count N       stop after N snapshots in batch mode\n"
+		"  -r, --record FILE   record users and processes to FILE\n"
+		"  -R, --replay FILE   show a recording instead of the system\n"
+		"  -D, --daemon        scan for viewers on this host (whowatchd)\n"
+		"      --proc DIR      read processes from DIR instead of /proc\n"
+		"      --utmp FILE     read logged in users from FILE\n"
+		"      --wtmp FILE     follow logins and logouts in FILE\n"
+		"  -T, --trace FILE    print a trace written on SIGUSR2 or a crash\n"
+		"  -h, --help          show this help\n", TIMEOUT);
+	exit(status);
+}
+
 int main (int argc, char **argv)
 {
-	struct timeval tv;
+	char *scanner = 0, *format = "json", *end, *record = 0, *replay = 0;
+	bool events = false, batch = false, shared = false;
+	bool daemon = !strcmp(basename(argv[0]), "whowatchd");
+	int c, events_fd = -1, interval = 0, shared_interval;
+	long count = 0;
+
+	trace_init();
+	while ((c = getopt_long(argc, argv, "s:ei:bf:n:r:R:DT:h", long_options, 0)) != -1) {
+		switch (c) {
+		case 's':
+			scanner = optarg;
+			break;
+		case 'e':
+			events = true;
+			break;
+		case 'i':
+			interval = strtol(optarg, &end, 10);
+			if (*end || interval < 1)
+				errx(EXIT_FAILURE, "bad interval: %s", optarg);
+			break;
+		case 'b':
+			batch = true;
+			break;
+		case 'f':
+			format = optarg;
+			break;
+		case 'n':
+			count = strtol(optarg, &end, 10);
+			if (*end || count < 0)
+				errx(EXIT_FAILURE, "bad count: %s", optarg);
+			break;
+		case 'r':
+			record = optarg;
+			break;
+		case 'R':
+			replay = optarg;
+			break;
+		case 'D':
+			daemon = true;
+			break;
+		case 'P':
+			proc_dir = optarg;
+			break;
+		case 'U':
+			utmp_file = optarg;
+			break;
+		case 'W':
+			wtmp_file = optarg;
+			break;
+		case 'T':
+			trace_print(optarg);
+			exit(EXIT_SUCCESS);
+		case 'h':
+			usage(EXIT_SUCCESS);
+		default:
+			usage(EXIT_FAILURE);
+		}
+	}
+	if (optind < argc) usage(EXIT_FAILURE);
+	if (batch && !batch_init(format, count))
+		errx(EXIT_FAILURE, "unknown format: %s", format);
+	if (replay && (batch || record || daemon))
+		errx(EXIT_FAILURE, "--replay goes only with the screen");
+	if (batch && daemon)
+		errx(EXIT_FAILURE, "--batch and --daemon don't go together");
+	if (!batch && !daemon && !replay && shared_attach(&shared_interval)) {
+		shared = true;
+		if (!interval) interval = shared_interval;
+	}
+	/* a replay is driven by its own clock, tick every second */
+	if (!interval) interval = replay ? 1 : TIMEOUT;
+	if (replay && !replay_init(replay, interval))
+		errx(EXIT_FAILURE, "%s: not a recording", replay);
+	if (record && !record_open(record))
+		err(EXIT_FAILURE, "%s", record);
+	recording = record;
 
 	machine_init ();
+	if (scanner && !set_scanner(scanner))
+		errx(EXIT_FAILURE, "unknown scanner: %s", scanner);
+	if (replay || shared) events = false;
+	if (events && (events_fd = tree_events_init()) == -1)
+		warn("process events are not available");
 	get_boot_time();
+	if (daemon) {
+		users_open();
+		loop_init(interval, daemon_tick);
+		daemon_init(interval);
+		prof_init(false);
+		if (events_fd != -1)
+			loop_add_fd(events_fd, events_ready, 0);
+		daemon_tick(0);
+		loop_run();
+	}
+	if (batch) {
+		users_open();
+		loop_init(interval, batch_tick);
+		prof_init(false);
+		if (events_fd != -1)
+			loop_add_fd(events_fd, events_ready, 0);
+		batch_tick(0);
+		loop_run();
+	}
 	get_rows_cols(&screen_rows, &screen_cols);
 	buf_size = screen_cols + screen_cols/2;
 	line_buf = xmalloc(buf_size);
 
 	curses_init();
 	current = &users_list;
-	users_init();
+	/* before anything adds a descriptor, that starts the timer */
+	loop_init(interval, tick);
+	users_init(!replay && !shared);
 	procwin_init();
+	history_init();
 	subwin_init();
 	menu_init();
-	signal(SIGINT, int_handler);
-	signal(SIGWINCH, winch_handler);  
-	//	signal(SIGSEGV, segv_handler);
+	loop_signal(SIGINT, int_handler);
+	loop_signal(SIGWINCH, resize);
+	prof_init(true);
+	loop_add_fd(STDIN_FILENO, keys_ready, 0);
+	if (events_fd != -1)
+		loop_add_fd(events_fd, events_ready, 0);
 
+	shared_tick();
+	replay_tick(0);
 	print_help();
 	update_load();
 	current->redraw();
@@ -222,27 +432,7 @@ int main (int argc, char **argv)
 	wnoutrefresh(info_win.wd);
 	wnoutrefresh(help_win.wd);
 	doupdate();
-	
-	tv.tv_sec = TIMEOUT;
-	tv.tv_usec = 0;
-	
-	for(;;) {				/* main loop */
-		fd_set rfds;
-		int retval;
-		
-		FD_ZERO(&rfds);
-		FD_SET(STDIN_FILENO,&rfds);
-		retval = select (STDIN_FILENO + 1, &rfds, NULL, NULL, &tv);
-
-		if (retval > 0) {
-			int key = read_key();
-			if (key != ERR) key_action(key);
-		}
-		if ((tv.tv_sec == 0) && (tv.tv_usec == 0)) {
-			ticks++;
-			periodic();
-			tv.tv_sec = TIMEOUT;
-		}
-		if (size_changed) resize();
-	}
+
+	loop_run();
+	return 0;
 }
@@ -1,17 +1,19 @@
 #include <stdbool.h>
-#include <sys/select.h>
 #include <utmpx.h>
 
 #include <curses.h>
 
 #include "kbd.h"
 #include "list.h"
+#include "ostree.h"
 
 #define member_size(type, member) sizeof(((type *)0)->member)
 
 #define CURSOR_COLOR	A_REVERSE
 #define NORMAL_COLOR	A_NORMAL
+#define MATCH_COLOR	10	/* pair of the search highlight */
 #define CMD_COLUMN	52
+#define USER_FORMAT	"%-14.14s %-9.9s %-6.6s %-19.19s %s"
 
 #define KEY_SKIPPED	false
 #define KEY_HANDLED	true
@@ -26,6 +28,10 @@ extern int screen_rows;
 extern int screen_cols;
 extern char *line_buf;
 extern int buf_size;
+extern const char *proc_dir;
+extern const char *utmp_file;
+extern const char *wtmp_file;
+void refresh_screen(void);
 
 /* screen.c */
 extern WINDOW *main_win;
@@ -48,26 +54,33 @@ struct window
 	bool (*keys)(int c);	/* keys handling 			*/
 	void (*periodic)(void);	/* periodic updates of window's data 	*/
 	void (*redraw)(void);	/* refreshes window content		*/
+	bool (*match)(int line);/* line matches the search, may be 0	*/
 };
 
 struct user_t
 {
-  struct list_head head;
+  struct os_node node;                  /* line in the users list       */
+  struct user_t *next_tty;              /* tty hash chain               */
   char name[member_size(struct utmpx, ut_user) + 1];    /* login name   */
   char tty[member_size(struct utmpx, ut_line) + 1];     /* tty          */
   int pid;                              /* pid of login shell           */
   char parent[16];                      /* login shell parent's name	*/
+  int tpgid;                            /* foreground process group     */
+  char *what;                           /* its command line             */
+  char idle[8];                         /* tty idle time                */
+  unsigned long long updated;           /* ticks + 1 at the last update */
+  bool full;                            /* full_cmd at the last update  */
 #ifdef HAVE_STRUCT_UTMPX_UT_HOST
   char host[member_size(struct utmpx, ut_host) + 1];
 #else
   char host[1];
 #endif
-  int line;                             /* line number                  */
 };
 
 /* whowatch.c */
 extern struct window users_list;
 extern struct window proc_win;
+extern struct window history_win;
 extern struct window *current;
 
 /* screen.c */
@@ -76,11 +89,8 @@ extern struct window info_win;
 
 struct process
 {
-        struct process **prev;
-        struct process *next;
-        int line;
-	char state;
-	int uid;
+	struct os_node node;		/* line in the process window	*/
+	struct process *dead;		/* next one waiting for removal	*/
 	struct proc_t *proc;
 };
 
@@ -88,22 +98,34 @@ struct process
 void help ();
 
 /* user.c */
-void users_init(void);
+void users_open(void);
+void users_init(bool live);
+int users_for_each(void (*func)(struct user_t *u, void *data), void *data);
+void users_live(void);
+void users_sync(int (*each)(void (*func)(struct user_t *u, void *data),
+			    void *data));
 void check_wtmp(void);
 void print_info(void);
 struct user_t *cursor_user(void);
-unsigned int user_search(int);
 void users_list_refresh();
 
+/* history.c */
+void history_init(void);
+void show_history(void);
+struct user_t *history_user(void);
+unsigned int history_search(int);
+
 /* whowatch.c */
 void send_signal (int, pid_t);
 
 /* process.c */
 void show_tree(pid_t);
 void procwin_init(void);
+bool tree_events_ready(void);
 pid_t cursor_pid(void);
-unsigned int getprocbyname(int);
+void tree_filter(void);
 void tree_title(struct user_t *);
+void tree_sync(void);
 void do_signal(int, int);
 
 /* screen.c */								
@@ -128,15 +150,26 @@ void key_end(struct window *);
 void update_load(void);
 void to_line(int, struct window *);
 
+/* loop.c */
+void loop_init(int sec, void (*func)(unsigned long long n));
+void loop_add_fd(int fd, void (*func)(int fd, void *data), void *data);
+void loop_del_fd(int fd);
+void loop_signal(int sig, void (*func)(int sig));
+void loop_run(void);
+
 /* proctree.c */
 void update_tree (void (*del) (void*));
+int tree_events_init (void);
+bool tree_events (void (*del) (void*));
+bool tree_reap (void (*del) (void*));
+bool tree_stale (void);
 
 /* procinfo.c */
 char *get_cmdline(int);
+int read_cmdline(int pid, char *buf, int size);
 int get_ppid(int);
 char *get_name(int);
 char *get_w(int pid);
-void get_state(struct process *p);
 char *count_idle (const char *tty);
 void get_boot_time(void);
 
@@ -159,7 +192,7 @@ void sub_switch(void);
 bool box_keys(int);
 void box_refresh(void);
 void box_resize(void);
-void input_box(char *, char *, char *,void (*)(char *));
+void input_box(char *, char *, char *,void (*)(char *), void (*)(char *));
 
 /* menu.c */
 void menu_refresh(void);
@@ -180,24 +213,95 @@ void builtin_sys_draw(void *);
 /* user_plugin.c */
 void builtin_user_draw(void *);
 
+/* batch.c */
+bool batch_init(const char *format, long count);
+void batch_tick(unsigned long long n);
+
+/* record.c */
+struct pinfo;
+bool record_open(const char *path);
+void record_tick(void);
+size_t record_snapshot(const unsigned char **p);
+bool replay_open(const char *path);
+void replay_load(const unsigned char *p, size_t len);
+bool replay_step(time_t t);
+void replay_seek(time_t t);
+void replay_times(time_t *now, time_t *first, time_t *last);
+void replay_procs(void (*func)(struct pinfo *i, void *data), void *data);
+char *replay_cmdline(struct pinfo *i);
+int replay_users(void (*func)(struct user_t *u, void *data), void *data);
+
+/* replay.c */
+bool replay_init(const char *path, int sec);
+void replay_tick(unsigned long long n);
+bool replay_keys(int key);
+bool replay_active(void);
+bool replay_status(char *buf, size_t size);
+
+/* shared.c */
+void daemon_init(int interval);
+void daemon_tick(unsigned long long n);
+bool shared_attach(int *interval);
+void shared_tick(void);
+
+/* prof.c */
+enum {
+	PROF_TICK, PROF_KEY, PROF_WTMP, PROF_SCAN, PROF_DELETE, PROF_SYNC,
+	PROF_DRAW, PROF_SUB, PROF_UPDATE, PROF_PHASES
+};
+void prof_init(bool on_screen);
+void prof_begin(int phase);
+void prof_end(int phase);
+bool prof_status(char *buf, size_t size);
+const char *prof_name(int phase);
+bool prof_shown(void);
+void prof_toggle(void);
+
+/* trace.c */
+enum {
+	TR_START, TR_TICK, TR_KEY, TR_REFRESH, TR_PHASE, TR_HELP,
+	TR_MENU_KEY, TR_EXIT, TR_SIGNAL, TR_SIGNAL_LIST, TR_SUB_KEY,
+	TR_PAD_DRAW, TR_PLUGIN, TR_USERS, TR_SEARCH, TR_CONN, TR_CRASH,
+	TRACE_EVENTS
+};
+void trace_event(int event, int a, int b, int c);
+void trace_init(void);
+void trace_print(const char *path);
+
 /* search.c */
 void do_search (const char *);
+void search_typed(char *);
+void search_next(bool);
+void search_forget(void);
+bool search_span(const char *, int *, int *);
 bool reg_match (const char *);
 
+/* filter.c */
+bool filter_set(const char *expr, char *err, size_t size);
+bool filter_on(void);
+char *filter_text(void);
+bool filter_match(struct pinfo *i);
+
 /* menu_hooks.c */
 void set_search(char *);
 void m_search ();
+void m_filter (void);
 
 /* kbd.c */
 int read_key ();
 
+/* wtmp.c */
+void wtmp_open(const char *path);
+int wtmp_read(void (*func)(struct utmpx *u, void *data), void *data);
+bool wtmp_back_open(const char *path);
+struct utmpx *wtmp_back(void);
+void wtmp_back_close(void);
+
 /* util.c */
-#ifndef RETURN_TV_IN_SELECT
-int _select (int nfds, fd_set *readfds, fd_set *writefds,
-	    fd_set *exceptfds, struct timeval *timeout);
-#define select _select
-#endif
+
 void* xmalloc (size_t size);
 void* xcalloc (size_t nmemb, size_t size);
 void *xrealloc (void *ptr, size_t size);
-void dolog (const char *format, ...);
+char *xstrdup (const char *s);
+char *format_idle (time_t idle, char *buf, size_t size);
+int open_dump (char *path);
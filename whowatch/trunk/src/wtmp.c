@@ -0,0 +1,236 @@
+/*
+ * Reading new wtmp records. The file is opened at its end, so
+ * startup doesn't depend on its size, and later only the part
+ * after the saved offset is mapped and decoded in place.
+ * Rotation is noticed by a new inode at the path, truncation by
+ * a smaller size or by the last record read being different.
+ *
+ * The history view reads the file the other way, from the end
+ * towards the beginning, through a window mapped a piece at a time.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_PATHS_H
+#include <paths.h>
+#endif
+#include <err.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "whowatch.h"
+
+#ifdef HAVE_UTMPNAME
+
+#define REC_SIZE	sizeof(struct utmpx)
+
+static const char *wtmp_path;
+static int wtmp_fd = -1;
+static ino_t wtmp_ino;
+static off_t wtmp_off;			/* end of the last record read	*/
+static struct utmpx last;		/* the record before wtmp_off	*/
+
+static bool reopen(void)
+{
+	struct stat st;
+	int fd;
+
+	if ((fd = open(wtmp_path, O_RDONLY | O_CLOEXEC)) == -1)
+		return false;
+	if (wtmp_fd != -1) close(wtmp_fd);
+	wtmp_fd = fd;
+	fstat(fd, &st);
+	wtmp_ino = st.st_ino;
+	wtmp_off = 0;
+	return true;
+}
+
+/*
+ * Open wtmp and skip all records that are already there.
+ */
+void wtmp_open(const char *path)
+{
+	struct stat st;
+
+	wtmp_path = path;
+	if (!reopen()) return;
+	fstat(wtmp_fd, &st);
+	wtmp_off = st.st_size - st.st_size % REC_SIZE;
+	if (wtmp_off &&
+	    pread(wtmp_fd, &last, REC_SIZE, wtmp_off - REC_SIZE) != REC_SIZE)
+		wtmp_off = 0;
+}
+
+/*
+ * Pass records from wtmp_off to the end of the file to func.
+ */
+static int read_tail(void (*func)(struct utmpx *u, void *data), void *data)
+{
+	struct stat st;
+	off_t start, end;
+	char *map, *p;
+	int n = 0;
+
+	if (fstat(wtmp_fd, &st) == -1) return 0;
+	end = st.st_size - (st.st_size - wtmp_off) % REC_SIZE;
+	if (end <= wtmp_off) return 0;
+
+	start = wtmp_off & ~((off_t) sysconf(_SC_PAGESIZE) - 1);
+	map = mmap(0, end - start, PROT_READ, MAP_PRIVATE, wtmp_fd, start);
+	if (map == MAP_FAILED) return 0;
+	for (p = map + (wtmp_off - start); p < map + (end - start);
+	     p += REC_SIZE, n++)
+		func((struct utmpx *) p, data);
+	memcpy(&last, map + (end - start) - REC_SIZE, REC_SIZE);
+	munmap(map, end - start);
+	wtmp_off = end;
+	return n;
+}
+
+/*
+ * Is the file still the one we have read up to wtmp_off?
+ */
+static bool same_file(void)
+{
+	struct utmpx u;
+	struct stat st;
+
+	if (fstat(wtmp_fd, &st) == -1 || st.st_size < wtmp_off)
+		return false;
+	if (!wtmp_off) return true;
+	return pread(wtmp_fd, &u, REC_SIZE, wtmp_off - REC_SIZE) == REC_SIZE &&
+		!memcmp(&u, &last, REC_SIZE);
+}
+
+/*
+ * Pass new records to func. Returns the number of records.
+ */
+int wtmp_read(void (*func)(struct utmpx *u, void *data), void *data)
+{
+	struct stat st;
+	int n = 0;
+
+	if (wtmp_fd == -1) {
+		if (!reopen()) return 0;
+	} else if (!stat(wtmp_path, &st) && st.st_ino != wtmp_ino) {
+		/* rotated, finish the old file first */
+		if (same_file())
+			n = read_tail(func, data);
+		if (!reopen()) return n;
+	} else if (!same_file()) {
+		wtmp_off = 0;
+	}
+	return n + read_tail(func, data);
+}
+
+#define BACK_WINDOW	(1 << 20)	/* bytes mapped at a time	*/
+
+static int back_fd = -1;
+static off_t back_pos;			/* start of the last record given */
+static char *back_map;
+static off_t back_start;		/* file offset of back_map	*/
+static size_t back_len;
+
+/*
+ * Start reading path backwards from its last complete record.
+ */
+bool wtmp_back_open(const char *path)
+{
+	struct stat st;
+
+	wtmp_back_close();
+	if ((back_fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+		return false;
+	if (fstat(back_fd, &st) == -1) {
+		wtmp_back_close();
+		return false;
+	}
+	back_pos = st.st_size - st.st_size % REC_SIZE;
+	return true;
+}
+
+/*
+ * Return the record before the previous one, or NULL at the start
+ * of the file. The record stays valid until the next call.
+ */
+struct utmpx *wtmp_back(void)
+{
+	off_t off, end;
+	void *map;
+
+	if (back_fd == -1 || back_pos < REC_SIZE) return 0;
+	off = back_pos - REC_SIZE;
+	if (!back_map || off < back_start) {
+		end = back_pos;
+		back_start = end > BACK_WINDOW ? end - BACK_WINDOW : 0;
+		back_start &= ~((off_t) sysconf(_SC_PAGESIZE) - 1);
+		if (back_map) munmap(back_map, back_len);
+		back_len = end - back_start;
+		map = mmap(0, back_len, PROT_READ, MAP_PRIVATE, back_fd,
+			   back_start);
+		if (map == MAP_FAILED) {
+			back_map = 0;
+			return 0;
+		}
+		back_map = map;
+	}
+	back_pos = off;
+	return (struct utmpx *) (back_map + (off - back_start));
+}
+
+void wtmp_back_close(void)
+{
+	if (back_map) munmap(back_map, back_len);
+	back_map = 0;
+	if (back_fd != -1) close(back_fd);
+	back_fd = -1;
+}
+
+#else /* !HAVE_UTMPNAME */
+
+/*
+ * The log can't be read as an array of struct utmpx here,
+ * getutxent() does it.
+ */
+void wtmp_open(const char *path)
+{
+	if (setutxdb (UTXDB_LOG, NULL) == -1) {
+	  err(1, "%s: cannot open wtmp database",
+	      __FUNCTION__);
+	}
+	setutxent ();
+	while (getutxent()) ;
+}
+
+int wtmp_read(void (*func)(struct utmpx *u, void *data), void *data)
+{
+	struct utmpx *u;
+	int n = 0;
+
+	for (; (u = getutxent()) != NULL; n++)
+		func(u, data);
+	return n;
+}
+
+/*
+ * getutxent() only goes forward, there is no history.
+ */
+bool wtmp_back_open(const char *path)
+{
+	return false;
+}
+
+struct utmpx *wtmp_back(void)
+{
+	return 0;
+}
+
+void wtmp_back_close(void)
+{
+}
+
+#endif /* HAVE_UTMPNAME */